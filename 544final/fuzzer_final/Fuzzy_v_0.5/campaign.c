@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+
+#include "campaign.h"
+
+campaign_state *campaign = NULL;
+
+// read CHECKPOINT_FILE into campaign, returns 0 on success
+static int campaign_load()
+{
+  FILE *f;
+  campaign_state cs;
+  int i;
+
+  f = fopen(CHECKPOINT_FILE, "r");
+  if (!f)
+    return -1;
+
+  if (fread(&cs, sizeof(cs), 1, f) != 1)
+  {
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+
+  // refuse checkpoints of other fuzzer builds - layout depends on WORKER_NUM and SYSCALL_NUM
+  if (cs.magic != CHECKPOINT_MAGIC || cs.version != CHECKPOINT_VERSION)
+    return -1;
+
+  memcpy(campaign, &cs, sizeof(cs));
+  campaign->resumes++;
+
+  for (i=0; i<WORKER_NUM; i++)
+  {
+    campaign->worker[i].batch += RESUME_BATCH_SKIP;
+    campaign->worker[i].cur_scid = -1;
+    campaign->worker[i].pid = 0;
+    // times of the calls before are from another boot
+    memset(campaign->worker[i].hist, 0, sizeof(campaign->worker[i].hist));
+  }
+
+  return 0;
+}
+
+// map shared campaign state, optionally restoring it from CHECKPOINT_FILE. Call before fork()
+int campaign_init(int resume)
+{
+  int i;
+
+  campaign = mmap(NULL, sizeof(campaign_state), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (campaign == MAP_FAILED)
+  {
+    campaign = NULL;
+    return -1;
+  }
+
+  if (resume)
+  {
+    if (campaign_load() == 0)
+      return 0;
+
+    printf("Can't resume from %s, starting new campaign...\n", CHECKPOINT_FILE);
+  }
+
+  memset(campaign, 0, sizeof(campaign_state));
+  campaign->magic = CHECKPOINT_MAGIC;
+  campaign->version = CHECKPOINT_VERSION;
+  campaign->started = time(NULL);
+
+  for (i=0; i<WORKER_NUM; i++)
+  {
+    campaign->worker[i].seed = rdtsc() + i;
+    campaign->worker[i].cur_scid = -1;
+  }
+
+  return 0;
+}
+
+// atomically replace CHECKPOINT_FILE with current campaign state
+int campaign_checkpoint()
+{
+  FILE *f;
+  int res;
+
+  if (!campaign)
+    return -1;
+
+  campaign->saved = time(NULL);
+
+  // write to temporary file first, so crash in the middle of checkpoint never spoils the previous one
+  f = fopen(CHECKPOINT_FILE ".tmp", "w");
+  if (!f)
+    return -1;
+
+  res = fwrite(campaign, sizeof(campaign_state), 1, f);
+  fflush(f);
+  fsync(fileno(f));
+  fclose(f);
+
+  if (res != 1)
+    return -1;
+
+  return rename(CHECKPOINT_FILE ".tmp", CHECKPOINT_FILE);
+}
+
+static unsigned long long monotonic_us()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// mark call of `scid` in flight, so crash can be bucketed by main process and kernel log matched by watchdog.
+// The watchdog reads records while we write them: seq goes to 0 first and back last, see campaign_call_at()
+void campaign_call_begin(worker_state *ws, int scid)
+{
+  call_record *cr = &ws->hist[(ws->calls + 1) % CALL_HIST_NUM];
+
+  cr->seq = 0;
+  __sync_synchronize();
+  cr->pid = getpid();
+  cr->scid = scid;
+  cr->end_us = 0;
+  cr->start_us = monotonic_us();
+  __sync_synchronize();
+  cr->seq = ++ws->calls;
+  ws->cur_scid = scid;
+}
+
+void campaign_call_end(worker_state *ws)
+{
+  ws->hist[ws->calls % CALL_HIST_NUM].end_us = monotonic_us();
+  ws->cur_scid = -1;
+}
+
+// copy of the call worker `ws` was making at `t_us` (CLOCK_MONOTONIC usec), 0 if it wasn't in one
+int campaign_call_at(worker_state *ws, unsigned long long t_us, call_record *cr)
+{
+  unsigned long seq;
+  int i;
+
+  for (i=0; i<CALL_HIST_NUM; i++)
+  {
+    seq = ws->hist[i].seq;
+    __sync_synchronize();
+    *cr = ws->hist[i];
+    __sync_synchronize();
+
+    // being rewritten for a new call, the one it held is CALL_HIST_NUM calls old
+    if (seq == 0 || seq != ws->hist[i].seq)
+      continue;
+
+    if (cr->start_us <= t_us && (cr->end_us == 0 || t_us <= cr->end_us))
+      return 1;
+  }
+
+  return 0;
+}
+
+// account a died worker in crash buckets
+void campaign_record_crash(int worker_id, int sig)
+{
+  worker_state *ws;
+  crash_bucket *cb = NULL;
+  int i;
+
+  if (!campaign || worker_id < 0 || worker_id >= WORKER_NUM)
+    return;
+
+  ws = &campaign->worker[worker_id];
+  ws->crashes++;
+
+  for (i=0; i<campaign->bucket_cnt; i++)
+  {
+    if (campaign->bucket[i].scid == ws->cur_scid && campaign->bucket[i].sig == sig)
+    {
+      cb = &campaign->bucket[i];
+      break;
+    }
+  }
+
+  if (!cb && campaign->bucket_cnt < CRASH_BUCKET_NUM)
+  {
+    cb = &campaign->bucket[campaign->bucket_cnt++];
+    cb->scid = ws->cur_scid;
+    cb->sig = sig;
+    cb->worker_id = worker_id;
+    cb->seed = ws->seed;
+    cb->batch = ws->batch;
+  }
+
+  if (cb)
+    cb->hits++;
+
+  // don't let reforked worker replay the batch which just killed it
+  ws->batch++;
+  ws->cur_scid = -1;
+}
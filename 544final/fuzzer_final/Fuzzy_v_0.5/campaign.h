@@ -0,0 +1,112 @@
+#ifndef CAMPAIGN_H_INCLUDED
+#define CAMPAIGN_H_INCLUDED
+
+#include <time.h>
+
+#include "fuzzer.h"
+#include "syscall_def.h"
+
+#define CHECKPOINT_FILE        "./checkpoint.dat"   // outside of log/ and pid/ so stop_clean.sh keeps it
+#define CHECKPOINT_MAGIC       0x465a4350           // "FZCP"
+#define CHECKPOINT_VERSION     3
+#define CHECKPOINT_TICKS       12                   // main loop ticks (5 sec each) between checkpoints
+
+// on --resume skip this many batches per worker: work done after the last checkpoint is lost,
+// and one of those batches probably took the whole machine down
+#define RESUME_BATCH_SKIP      32
+
+#define CALL_HIST_NUM          16                   // calls remembered per worker, to match kernel log timestamps against
+
+#define CRASH_BUCKET_NUM       64
+#define KFINDING_NUM           64                   // kernel log findings ring size
+#define KFINDING_MSG_LEN       120
+
+// one call of a worker, in CLOCK_MONOTONIC usec - the clock of /dev/kmsg timestamps
+typedef struct
+{
+  unsigned long       seq;                   // call number, 0 while the record is being rewritten
+  int                 pid;
+  int                 scid;
+  unsigned long long  start_us;
+  unsigned long long  end_us;                // 0 while the call is in flight
+
+} call_record;
+
+// per-worker campaign state, each worker writes only its own record
+typedef struct
+{
+  unsigned int   seed;                       // base seed, rand() is reseeded with seed+batch on every batch
+  unsigned long  batch;                      // position: number of batches started
+  int            pid;                        // current pid of this worker
+  // "current call" slot, read by watchdog to correlate kernel log with workers
+  unsigned long  calls;                      // total syscalls made, also sequence number of call in flight
+  int            cur_scid;                   // syscall in flight, -1 when idle
+  call_record    hist[CALL_HIST_NUM];        // last calls, call n is in hist[n % CALL_HIST_NUM]
+  int            crashes;                    // how many times this worker died
+  unsigned long  sc_calls[SYSCALL_NUM];      // per-syscall statistics, indexed as fuzzer_call_spec_list
+  unsigned long  sc_fails[SYSCALL_NUM];
+
+} worker_state;
+
+// crashes are bucketed by syscall and signal, first hit is kept as reproducer (corpus entry)
+typedef struct
+{
+  int            scid;
+  int            sig;
+  unsigned long  hits;
+  int            worker_id;                  // reproducer: worker id, seed and batch of the first hit
+  unsigned int   seed;
+  unsigned long  batch;
+
+} crash_bucket;
+
+// kernel log (WARN/BUG/oops/lockdep) record matched to the call in flight
+typedef struct
+{
+  time_t         t;
+  unsigned long  kseq;                       // /dev/kmsg sequence number
+  int            worker_id;                  // -1 if can't be attributed to a single worker
+  int            scid;
+  unsigned long  call_seq;
+  char           msg[KFINDING_MSG_LEN];
+
+} kernel_finding;
+
+// whole campaign state, lives in memory shared by main and all workers
+typedef struct
+{
+  unsigned int   magic;
+  unsigned int   version;
+  time_t         started;                    // campaign start time (kept across resumes)
+  time_t         saved;                      // time of the last checkpoint
+  int            resumes;                    // number of times campaign was resumed
+
+  worker_state   worker[WORKER_NUM];
+
+  int            bucket_cnt;                 // written by main process only
+  crash_bucket   bucket[CRASH_BUCKET_NUM];
+
+  unsigned long  kfinding_cnt;               // written by watchdog process only, kfinding[] is a ring
+  kernel_finding kfinding[KFINDING_NUM];
+
+} campaign_state;
+
+extern campaign_state *campaign;
+
+// map shared campaign state, optionally restoring it from CHECKPOINT_FILE. Call before fork()
+int  campaign_init(int resume);
+
+// atomically replace CHECKPOINT_FILE with current campaign state
+int  campaign_checkpoint();
+
+// mark call of `scid` in flight / done, for crash buckets and kernel log matching
+void campaign_call_begin(worker_state *ws, int scid);
+void campaign_call_end(worker_state *ws);
+
+// copy of the call worker `ws` was making at `t_us` (CLOCK_MONOTONIC usec), 0 if it wasn't in one
+int  campaign_call_at(worker_state *ws, unsigned long long t_us, call_record *cr);
+
+// account a died worker in crash buckets
+void campaign_record_crash(int worker_id, int sig);
+
+#endif // CAMPAIGN_H_INCLUDED
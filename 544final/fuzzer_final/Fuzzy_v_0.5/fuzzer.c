@@ -8,14 +8,22 @@
 
 #include <sys/wait.h>
 #include <sys/resource.h>
+#include <sys/epoll.h>
 
 #include "fuzzer.h"
 #include "sandbox.h"
+#include "campaign.h"
+#include "kmsg.h"
+#include "reslimit.h"
+#include "profile.h"
+#include "lz.h"
 
 // global shared multiprocess data
 typedef struct {
   int  id;       // id of worker
   FILE *flog;
+  char logname[64];  // log path without ".log", rotated segments are <logname>.NNNN.seg
+  int  seg;          // next segment number
   int pid;
   int ptype;     // one of the def, main, wd, worker
   int died;
@@ -25,6 +33,9 @@ typedef struct {
 static proc_desc  ppd[PPD_SIZE];
 static int proc_desc_cnt = 0;
 
+// our own record in shared campaign state (workers only)
+static worker_state *my_state = NULL;
+
 char log_strbuf[2048*10];
 char strbuf [64*1024];
 char outbuf [64*1024];
@@ -78,7 +89,7 @@ proc_desc* get_proc_desc(int pid)
 // register new process - main, worker or watchdog
 proc_desc* register_new_process(int pid, int ptype, int id, int replace_died_pid)
 {
-  char str[64], str2[64];
+  char str[96], str2[64];
   FILE *fpid;
   proc_desc *pd = NULL;
 
@@ -106,17 +117,39 @@ proc_desc* register_new_process(int pid, int ptype, int id, int replace_died_pid
     case PROC_TYPE_MAIN:  strcpy(str2, "main_"); break;
     case PROC_TYPE_WD:    strcpy(str2, "wd_"); break;
     case PROC_TYPE_WORKER: strcpy(str2,"worker_"); break;
+    case PROC_TYPE_DRAINER: strcpy(str2,"drainer_"); break;
     default: strcpy(str2, ""); break;
   }
 
   //create pid file
-  sprintf(str, "pid/%s%d.pid", str2, pid);
+  snprintf(str, sizeof(str), "pid/%s%d.pid", str2, pid);
   fpid = fopen(str, "w");
-  fclose(fpid);
+  if (fpid)
+    fclose(fpid);
+
+  //create log file, a cut name would write over somebody else's log - no log then
+  pd->flog = NULL;
+  pd->seg = 0;
+  if (snprintf(pd->logname, sizeof(pd->logname), "log/%s%d", str2, pid) < (int)sizeof(pd->logname)
+      && snprintf(str, sizeof(str), "%s.log", pd->logname) < (int)sizeof(str))
+    pd->flog = fopen(str, "w");
+  else
+    fprintf(stderr, "Log name of pid=%d is too long, not logging\n", pid);
 
-  //create log file
-  sprintf(str, "log/%s%d.log", str2, pid);
-  pd->flog = fopen(str, "w");
+  // keep single worker from starving others: rlimits are set by worker itself, cgroup placement by main
+  if (ptype == PROC_TYPE_WORKER)
+  {
+    if (pid == getpid())
+    {
+      if (reslimit_apply_rlimits() != 0)
+        log_(pid, "Can't apply worker rlimits", PROC_TYPE_DEF );
+    }
+    else if (reslimit_cgroup_place(id, pid) != 0)
+    {
+      sprintf(log_strbuf, "Can't place worker #%d pid=%d into its cgroup", id, pid);
+      log_(getpid(), log_strbuf, PROC_TYPE_DEF );
+    }
+  }
 
   return pd;
 }
@@ -136,12 +169,31 @@ int unregister_process(int pid, int ptype)
     case PROC_TYPE_MAIN:  strcpy(str2, "main_"); break;
     case PROC_TYPE_WD:    strcpy(str2, "wd_"); break;
     case PROC_TYPE_WORKER: strcpy(str2,"worker_"); break;
+    case PROC_TYPE_DRAINER: strcpy(str2,"drainer_"); break;
     default: strcpy(str2, ""); break;
   }
    sprintf(str, "pid/%s%d.pid", str2, pid);
    return remove(str);
 }
 
+// close log segment which reached LOG_SEGMENT_SIZE and start a new one, drainer compresses closed segments
+static void log_rotate(proc_desc *pd)
+{
+  char str[96], str2[96];
+
+  if (!pd || !pd->flog || ftell(pd->flog) < LOG_SEGMENT_SIZE)
+    return;
+
+  fclose(pd->flog);
+
+  // register_new_process() made sure logname fits
+  snprintf(str, sizeof(str), "%s.log", pd->logname);
+  snprintf(str2, sizeof(str2), "%s.%04d.seg", pd->logname, pd->seg++);
+  rename(str, str2);
+
+  pd->flog = fopen(str, "w");
+}
+
 // write log
 int log_(int pid, const char *src, int ptype)
 {
@@ -149,7 +201,7 @@ int log_(int pid, const char *src, int ptype)
 
   if (!pd && ptype == PROC_TYPE_DEF) return -1;  //can't write log
 
-  if (!pd)
+  if (!pd || !pd->flog)
     return -1;
 
   fprintf(pd->flog, "[%d] %s\n", pid, src);
@@ -158,6 +210,8 @@ int log_(int pid, const char *src, int ptype)
   fflush(pd->flog);
   fsync( fileno(pd->flog) );
 
+  log_rotate(pd);
+
   return 0;
 }
 
@@ -171,7 +225,8 @@ static int close_log(int pid)
    log_(pid, "Normal process shutdown due to `close_log()` call...", PROC_TYPE_DEF);
    log_(pid, "\n\n", PROC_TYPE_DEF);
 
-   fclose(pd->flog);
+   if (pd->flog)
+     fclose(pd->flog);
 
    return 0;
 }
@@ -219,6 +274,9 @@ void SIGCHLD_handler(sig)
     // flag to recreate worker ASAP
     pd->died = 1;
 
+    if (pd->ptype == PROC_TYPE_WORKER && WIFSIGNALED(status))
+      campaign_record_crash(pd->id, WTERMSIG(status));
+
     printf("Worker #%d crashed. Pid=%d\n", pd->id, pid);
 
     sprintf( log_strbuf, "Worker #%d crashed. Pid=%d", pd->id, pid);
@@ -247,49 +305,66 @@ void signal_handler(sig)
 	}
 }
 
+// main process: set on SIGTERM, main loop saves campaign before going down, so it can be continued with --resume.
+// Checkpoint isn't async-signal-safe and main loop may be in the middle of writing one
+static volatile sig_atomic_t main_stop = 0;
+
+void main_signal_handler(int sig)
+{
+    main_stop = sig;
+}
+
 // fuzz single syscall specified number of times
 long sc_batch_single(int scid, int times)
 {
-   int i;
-   long ret;
+   int i, idx;
+   long ret = -1;
 
    if (scid < 0)
      return -1;
 
+   idx = get_scall_idx(scid);
+
    for (i=0; i<times; i++)
    {
+     log_rotate(get_proc_desc(getpid()));
+
+     campaign_call_begin(my_state, scid);
      ret = sandbox_syscall_run( scid, get_log_stream(getpid()) );
+     campaign_call_end(my_state);
+
+     my_state->sc_calls[idx]++;
+     if (ret == -1)
+       my_state->sc_fails[idx]++;
+
      sleep(1);
    }
    return ret;
 }
 
 // call all defined syscalls one by one - one cycle, regardless of the result of calls
-// 'times' is same syscall sequence size
+// 'times' is same syscall sequence size unless profile sets it; syscalls with zero weight are skipped
 void sc_batch_roundrobbin(int times)
 {
    int i;
 
    for (i=0; i<SYSCALL_NUM; i++)
    {
-     if (fuzzer_call_spec_list[i].scid != -1)
-       sc_batch_single(fuzzer_call_spec_list[i].scid, times);
+     if (fuzzer_call_spec_list[i].scid != -1 && profile_weight(i) > 0)
+       sc_batch_single(fuzzer_call_spec_list[i].scid, profile_batch_len(i, times));
    }
 }
 
-// call all defined syscalls randomly
-// 'times' is same syscall sequence size
+// call syscall chosen randomly according to profile weights
+// 'times' is same syscall sequence size unless profile sets it
 void sc_batch_random(int times)
 {
-  int i = 0;
-  int scid;
-  do
-  {
-    i = rand() % SYSCALL_NUM;
-  } while( fuzzer_call_spec_list[i].scid == -1 );
+  int i = profile_pick();
+
+  if (i == -1 || fuzzer_call_spec_list[i].scid == -1)
+    return;
 
-  scid = fuzzer_call_spec_list[i].scid;
-  sc_batch_single(scid, times);
+  sc_batch_single(fuzzer_call_spec_list[i].scid, profile_batch_len(i, times));
 }
 
 // worker function - never exited
@@ -298,16 +373,18 @@ void worker(int id)
           // child process run here
           setpgid(0, 0);
 
-          // randomize each child process random ganarator
-          srand(rdtsc());
+          // seed & position are kept in campaign state, so batches are reproducible and survive restarts
+          my_state = &campaign->worker[id];
+          my_state->pid = getpid();
 
           signal(SIGTSTP,SIG_IGN); /* ignore tty signals */
           signal(SIGTTOU,SIG_IGN);
           signal(SIGTTIN,SIG_IGN);
+          signal(SIGXFSZ,SIG_IGN); /* RLIMIT_FSIZE hit, let write() fail with EFBIG instead */
           signal(SIGHUP, signal_handler); /* catch hangup signal */
           signal(SIGTERM, signal_handler); /* catch kill signal */
 
-          fprintf(get_log_stream(getpid()), "Worker process #%d log. pid=%d\n", id, getpid());
+          fprintf(get_log_stream(getpid()), "Worker process #%d log. pid=%d, seed=%u, batch=%lu\n", id, getpid(), my_state->seed, my_state->batch);
           sleep(1);
 
           // we need to preallocate some resources - fd's...
@@ -315,6 +392,12 @@ void worker(int id)
 
           while(1)
           {
+            // operator may have edited weight profile
+            if (profile_reload())
+              log_(getpid(), "Syscall weight profile (re)loaded", PROC_TYPE_DEF );
+
+            srand(my_state->seed + my_state->batch);
+
             switch (id)
             {
               case 0:
@@ -337,6 +420,7 @@ void worker(int id)
                 sc_batch_roundrobbin(1);
               break;
             }
+            my_state->batch++;
             sleep(1);
           }
 
@@ -345,12 +429,68 @@ void worker(int id)
         return;
 }
 
+// drainer process - compresses rotated log segments off the workers' critical path, never returns
+void drainer()
+{
+  DIR *dir;
+  struct dirent *ent;
+  char src[300], dst[310];
+  int len;
+
+  setpgid(0, 0);
+
+  signal(SIGCHLD,SIG_IGN);
+  signal(SIGTSTP,SIG_IGN); /* ignore tty signals */
+  signal(SIGTTOU,SIG_IGN);
+  signal(SIGTTIN,SIG_IGN);
+  signal(SIGHUP,signal_handler); /* catch hangup signal */
+  signal(SIGTERM,signal_handler); /* catch kill signal */
+
+  if (nice(LOG_DRAIN_NICE) == -1)
+    log_(getpid(), "Can't lower drainer priority", PROC_TYPE_DEF );
+
+  log_(getpid(), "Log drainer process log start.", PROC_TYPE_DEF );
+
+  while(1)
+  {
+    if ((dir = opendir("log/")) != NULL)
+    {
+      while ((ent = readdir(dir)) != NULL)
+      {
+        len = strlen(ent->d_name);
+        if (len < 5 || strcmp(ent->d_name + len - 4, ".seg") != 0)
+          continue;
+
+        sprintf(src, "log/%s", ent->d_name);
+        sprintf(dst, "%s.lz", src);
+
+        if (lz_compress_file(src, dst) == 0)
+          remove(src);
+        else
+        {
+          remove(dst);
+          sprintf(log_strbuf, "Can't compress log segment %s", src);
+          log_(getpid(), log_strbuf, PROC_TYPE_DEF );
+        }
+      }
+      closedir(dir);
+    }
+
+    sleep(LOG_DRAIN_PERIOD);
+  }
+}
+
 // execution starts here
-int main()
+int main(int argc, char **argv)
 {
   char  dir_pid[8];
   int   id;
   pid_t fork_res;
+  int   resume = 0;
+  int   kfd, epfd;
+  time_t wd_tick;
+  FILE *kstream;
+  struct epoll_event ev;
 
   DIR *dir;
   struct dirent *ent;
@@ -369,6 +509,31 @@ int main()
     }
   }
 
+  for (id=1; id<argc; id++)
+  {
+    if (strcmp(argv[id], "--resume") == 0)
+      resume = 1;
+    else
+    {
+      printf("usage: %s [--resume]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  // shared campaign state must exist before any worker is forked
+  if (campaign_init(resume) != 0)
+  {
+    printf("Can't allocate campaign state. Exiting...\n");
+    return 1;
+  }
+
+  if (campaign->resumes)
+    printf("Resuming campaign (resume #%d, last checkpoint at %s)\n", campaign->resumes, ctime(&campaign->saved));
+
+  // per-worker cgroup leaves with memory, pids and io limits
+  if (reslimit_cgroup_init() != 0)
+    printf("Can't set up cgroup %s, workers will run with rlimits only\n", CGROUP_FUZZER);
+
   // subprocess creation starts here
   for (id=0;id<WORKER_NUM;id++)
   {
@@ -428,6 +593,20 @@ int main()
 
       log_(getpid(), "WatchDog process log start.", PROC_TYPE_DEF );
 
+      // follow kernel log, findings which don't kill the worker are caught here
+      kfd = kmsg_open();
+      epfd = epoll_create1(0);
+      ev.events = EPOLLIN;
+      ev.data.fd = kfd;
+
+      if (kfd == -1 || epfd == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, kfd, &ev) == -1)
+      {
+        log_(getpid(), "Can't follow " KMSG_DEV ", kernel log correlation disabled", PROC_TYPE_DEF );
+        if (kfd != -1)
+          close(kfd);
+        kfd = -1;
+      }
+
       // WD loop never returns
       while(1)
       {
@@ -440,7 +619,25 @@ int main()
                 log_(getpid(), "Watching for workers... ", PROC_TYPE_DEF );
               }
           }
-          sleep(30);
+
+          if (kfd == -1)
+          {
+            sleep(30);
+            continue;
+          }
+
+          // wait for kernel log records until next 30 sec tick
+          wd_tick = time(NULL) + 30;
+          while (time(NULL) < wd_tick)
+          {
+            // findings go to our own log, rotated like any other
+            if (epoll_wait(epfd, &ev, 1, (wd_tick - time(NULL)) * 1000) > 0)
+            {
+              kstream = get_log_stream(getpid());
+              kmsg_drain(kfd, kstream? kstream : stderr);
+              log_rotate(get_proc_desc(getpid()));
+            }
+          }
       }
   }
 
@@ -448,12 +645,34 @@ int main()
   sprintf( log_strbuf, "Just created WatchDog process with pid=%d.", fork_res);
   log_(getpid(), log_strbuf, PROC_TYPE_DEF );
 
+  // fork log drainer here
+  fork_res=fork();
+
+  if (fork_res == 0)
+  {
+      register_new_process(getpid(), PROC_TYPE_DRAINER, id, 0);
+      drainer();  // never returns !!!
+  }
+
+  sprintf( log_strbuf, "Just created log drainer process with pid=%d.", fork_res);
+  log_(getpid(), log_strbuf, PROC_TYPE_DEF );
+
+  signal(SIGTERM, main_signal_handler);
+
   id = 0;
 
   while(1)
   {
       int i;
 
+      // SIGTERM also cuts sleep() below short
+      if (main_stop)
+      {
+        if (campaign_checkpoint() != 0)
+          log_(getpid(), "Can't save campaign checkpoint on exit", PROC_TYPE_DEF );
+        signal_handler(main_stop);
+      }
+
       //let's try to recreate died workers if any
       for (i=0; i<proc_desc_cnt; i++)
       {
@@ -481,6 +700,16 @@ int main()
         worker(ppd[i].id);  // never returns !!!
       }
 
+      // periodic checkpoint, so reboot-inducing crash costs minutes of work only
+      if (tick % CHECKPOINT_TICKS == 0)
+      {
+        if (campaign_checkpoint() == 0)
+          sprintf(log_strbuf, "Campaign checkpoint saved to %s", CHECKPOINT_FILE);
+        else
+          sprintf(log_strbuf, "Can't save campaign checkpoint to %s", CHECKPOINT_FILE);
+        log_(getpid(), log_strbuf, PROC_TYPE_DEF );
+      }
+
       printf("Nothing to do for main process... %d\n", tick);
       dump_ppd();
       sleep(5);
@@ -1,21 +1,31 @@
 #ifndef FUZZER_H_INCLUDED
 #define FUZZER_H_INCLUDED
 
-#define SELF_VERSION        "0.5"
+#define SELF_VERSION        "0.6"
 
 //uncomment to debug fork stuff
 //#define DEBUG_FORK         // used to see detailed process table updates
 
 //multiprocess defines
 #define WORKER_NUM          4
-#define PPD_SIZE            WORKER_NUM+2
+#define PPD_SIZE            WORKER_NUM+3
 
 #define PROC_TYPE_DEF       -1   // default,  used as argument to autodetect, etc
 #define PROC_TYPE_MAIN      0
 #define PROC_TYPE_WD        1
 #define PROC_TYPE_WORKER    2
 #define PROC_TYPE_SHELL     3   // process is command line shell to display status, etc
+#define PROC_TYPE_DRAINER   4   // compresses rotated log segments
+
+//sandbox defines
+#define SANDBOX_DIR         "./sandbox"     // related to current (returned by pwd)
+
+//logging defines
+#define LOG_SEGMENT_SIZE    (8*1024*1024)   // log is rotated into log/<name>.NNNN.seg when it grows over this
+#define LOG_DRAIN_PERIOD    10              // seconds between drainer scans of log/
+#define LOG_DRAIN_NICE      10              // drainer must not compete with workers
 
 int log_(int pid, const char *src, int ptype);
+unsigned int rdtsc();
 
 #endif // FUZZER_H_INCLUDED
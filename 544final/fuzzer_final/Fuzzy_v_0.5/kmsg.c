@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "kmsg.h"
+#include "campaign.h"
+
+// kernel log lines which start a splat worth reporting
+static const char *kmsg_patterns[] =
+{
+  "WARNING:",
+  "BUG:",
+  "Oops",
+  "general protection fault",
+  "lockdep",
+  "circular locking dependency",
+  "inconsistent lock state",
+  NULL
+};
+
+// lines which only continue the splat of the finding before them ("BUG: unable to handle ..." is followed by "Oops: ...")
+static const char *kmsg_followups[] =
+{
+  "Oops",
+  NULL
+};
+
+// calls workers were making at the time of the pending finding, scid -1 if none
+static call_record      kmsg_snap[WORKER_NUM];
+static kernel_finding*  kmsg_pending = NULL;   // last finding, waiting for "PID: n" line of its splat
+static int              kmsg_pending_left = 0;
+
+// open kernel log for non-blocking reading, positioned after last existing record. -1 on error
+int kmsg_open()
+{
+  int fd = open(KMSG_DEV, O_RDONLY | O_NONBLOCK);
+
+  if (fd == -1)
+    return -1;
+
+  // old records are not ours
+  lseek(fd, 0, SEEK_END);
+
+  return fd;
+}
+
+static int kmsg_is_finding(const char *msg)
+{
+  int i;
+
+  for (i=0; kmsg_patterns[i]; i++)
+  {
+    if (strstr(msg, kmsg_patterns[i]))
+      return 1;
+  }
+
+  return 0;
+}
+
+static int kmsg_is_followup(const char *msg)
+{
+  int i;
+
+  for (i=0; kmsg_followups[i]; i++)
+  {
+    if (strncmp(msg, kmsg_followups[i], strlen(kmsg_followups[i])) == 0)
+      return 1;
+  }
+
+  return 0;
+}
+
+static const char* kmsg_scname(int scid)
+{
+  const scall_desc* scdesc = get_scall_desc(scid);
+  return (scdesc)? scdesc->name : "idle";
+}
+
+// set finding's call from snapshot slot of worker `i`
+static void kmsg_attribute(kernel_finding *kf, int i)
+{
+  kf->worker_id = i;
+  kf->scid = kmsg_snap[i].scid;
+  kf->call_seq = kmsg_snap[i].seq;
+}
+
+// new finding: look up the calls workers were making at record's timestamp `ts_us`,
+// attribute right away if only one worker was inside a syscall
+static kernel_finding* kmsg_record(unsigned long kseq, unsigned long long ts_us, const char *msg, FILE* log_stream)
+{
+  kernel_finding *kf = &campaign->kfinding[campaign->kfinding_cnt % KFINDING_NUM];
+  int i, inflight = 0, last = -1;
+
+  for (i=0; i<WORKER_NUM; i++)
+  {
+    if (campaign_call_at(&campaign->worker[i], ts_us, &kmsg_snap[i]))
+    {
+      inflight++;
+      last = i;
+    }
+    else
+    {
+      kmsg_snap[i].pid = 0;
+      kmsg_snap[i].scid = -1;
+    }
+  }
+
+  kf->t = time(NULL);
+  kf->kseq = kseq;
+  kf->worker_id = -1;
+  kf->scid = -1;
+  kf->call_seq = 0;
+  strncpy(kf->msg, msg, KFINDING_MSG_LEN-1);
+  kf->msg[KFINDING_MSG_LEN-1] = 0;
+
+  if (inflight == 1)
+    kmsg_attribute(kf, last);
+
+  campaign->kfinding_cnt++;
+
+  fprintf(log_stream, "Kernel finding #%lu (kmsg seq %lu): `%s`\n", campaign->kfinding_cnt, kseq, kf->msg);
+  for (i=0; i<WORKER_NUM; i++)
+  {
+    if (kmsg_snap[i].scid != -1)
+      fprintf(log_stream, "   in flight: worker #%d pid=%d call #%lu `%s`\n", i, kmsg_snap[i].pid, kmsg_snap[i].seq, kmsg_scname(kmsg_snap[i].scid));
+  }
+  fflush(log_stream);
+
+  return kf;
+}
+
+// splat tells us who was current: "CPU: 1 PID: 1234 Comm: fuzzer ...", newer kernels put it into WARNING line itself.
+// returns 1 if line had a pid
+static int kmsg_match_pid(const char *msg, FILE* log_stream)
+{
+  const char *p;
+  int i, pid;
+
+  if ((p = strstr(msg, "PID: ")) == NULL)
+    return 0;
+
+  pid = atoi(p+5);
+
+  for (i=0; i<WORKER_NUM; i++)
+  {
+    if (kmsg_snap[i].scid != -1 && kmsg_snap[i].pid == pid)
+    {
+      kmsg_attribute(kmsg_pending, i);
+      fprintf(log_stream, "   attributed to worker #%d pid=%d call #%lu `%s`\n", i, pid, kmsg_pending->call_seq, kmsg_scname(kmsg_pending->scid));
+      fflush(log_stream);
+      break;
+    }
+  }
+
+  return 1;
+}
+
+// read all pending kernel log records, match findings to workers' calls in flight and log them.
+// returns number of new findings
+int kmsg_drain(int fd, FILE* log_stream)
+{
+  char rec[KMSG_REC_SIZE];
+  char *msg, *p;
+  unsigned long kseq;
+  unsigned long long ts_us;
+  int n, found = 0;
+
+  while (1)
+  {
+    n = read(fd, rec, sizeof(rec)-1);
+
+    if (n < 0)
+    {
+      // EPIPE: ring buffer wrapped over unread records, next read continues from oldest available
+      if (errno == EPIPE || errno == EINTR)
+        continue;
+      break;  // EAGAIN - nothing more to read
+    }
+
+    if (n == 0)
+      break;
+
+    rec[n] = 0;
+
+    // record is "prio,seq,timestamp,flags;message\n[ KEY=value\n...]"
+    if (sscanf(rec, "%*u,%lu,%llu,", &kseq, &ts_us) != 2 || (msg = strchr(rec, ';')) == NULL)
+      continue;
+    msg++;
+    if ((p = strchr(msg, '\n')) != NULL)
+      *p = 0;
+
+    // one splat may match several patterns (BUG + Oops), report it once.
+    // Any other finding starts a new splat, the pending one stays attributed by time only
+    if (kmsg_pending_left > 0 && (!kmsg_is_finding(msg) || kmsg_is_followup(msg)))
+    {
+      kmsg_pending_left--;
+
+      if (kmsg_match_pid(msg, log_stream))
+        kmsg_pending_left = 0;
+
+      continue;
+    }
+
+    if (kmsg_is_finding(msg))
+    {
+      kmsg_pending = kmsg_record(kseq, ts_us, msg, log_stream);
+      kmsg_pending_left = (kmsg_match_pid(msg, log_stream))? 0 : KMSG_PID_WINDOW;
+      found++;
+    }
+  }
+
+  return found;
+}
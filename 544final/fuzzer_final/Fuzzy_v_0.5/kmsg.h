@@ -0,0 +1,17 @@
+#ifndef KMSG_H_INCLUDED
+#define KMSG_H_INCLUDED
+
+#include <stdio.h>
+
+#define KMSG_DEV          "/dev/kmsg"
+#define KMSG_REC_SIZE     8192      // /dev/kmsg returns exactly one record per read(), never longer than this
+#define KMSG_PID_WINDOW   16        // number of records after a finding to look for "PID: n" line of the splat
+
+// open kernel log for non-blocking reading, positioned after last existing record. -1 on error
+int  kmsg_open();
+
+// read all pending kernel log records, match findings to workers' calls in flight and log them.
+// returns number of new findings
+int  kmsg_drain(int fd, FILE* log_stream);
+
+#endif // KMSG_H_INCLUDED
@@ -0,0 +1,102 @@
+// logcat - print or grep fuzzer logs, both live *.log files and compressed *.seg.lz segments
+//
+//   ./logcat log/worker_1234.*                     - dump all segments of worker 1234
+//   ./logcat -e "SYS_mknod" log/*                  - lines containing SYS_mknod, prefixed with file name
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lz.h"
+
+#define LOGCAT_LINE_MAX   (64*1024)
+
+typedef struct
+{
+  const char *path;
+  const char *pattern;     // NULL - print everything
+  int         show_name;
+  int         matches;
+  char        line[LOGCAT_LINE_MAX];
+  int         len;
+
+} logcat_ctx;
+
+static void logcat_line(logcat_ctx *ctx)
+{
+  ctx->line[ctx->len] = 0;
+
+  if (!ctx->pattern || strstr(ctx->line, ctx->pattern))
+  {
+    if (ctx->show_name)
+      printf("%s:", ctx->path);
+    fwrite(ctx->line, 1, ctx->len, stdout);
+    putchar('\n');
+    ctx->matches++;
+  }
+
+  ctx->len = 0;
+}
+
+// split decompressed chunks into lines, a line may continue in the next chunk
+static void logcat_chunk(const char *buf, int len, void *arg)
+{
+  logcat_ctx *ctx = arg;
+  int i;
+
+  for (i=0; i<len; i++)
+  {
+    if (buf[i] == '\n' || ctx->len == LOGCAT_LINE_MAX-1)
+      logcat_line(ctx);
+    if (buf[i] != '\n')
+      ctx->line[ctx->len++] = buf[i];
+  }
+}
+
+int main(int argc, char **argv)
+{
+  static logcat_ctx ctx;
+  int opt, i, res = 0;
+
+  while ((opt = getopt(argc, argv, "e:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'e':
+        ctx.pattern = optarg;
+        break;
+      default:
+        printf("usage: %s [-e pattern] file...\n", argv[0]);
+        return 2;
+    }
+  }
+
+  if (optind >= argc)
+  {
+    printf("usage: %s [-e pattern] file...\n", argv[0]);
+    return 2;
+  }
+
+  ctx.show_name = (ctx.pattern && argc - optind > 1);
+
+  for (i=optind; i<argc; i++)
+  {
+    ctx.path = argv[i];
+    ctx.len = 0;
+
+    if (lz_read_file(argv[i], logcat_chunk, &ctx) != 0)
+    {
+      fprintf(stderr, "%s: can't read or corrupted\n", argv[i]);
+      res = 2;
+    }
+
+    if (ctx.len)
+      logcat_line(&ctx);
+  }
+
+  // same exit codes as grep
+  if (res)
+    return res;
+  return (ctx.pattern && !ctx.matches)? 1 : 0;
+}
@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "lz.h"
+
+static uint32_t lz_read32(const unsigned char *p)
+{
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static int lz_hash(uint32_t v)
+{
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// write length continuation bytes for a nibble which overflowed
+static int lz_put_len(unsigned char *dst, int op, int cap, int len)
+{
+  while (len >= 255)
+  {
+    if (op >= cap)
+      return -1;
+    dst[op++] = 255;
+    len -= 255;
+  }
+  if (op >= cap)
+    return -1;
+  dst[op++] = len;
+
+  return op;
+}
+
+// emit one sequence: literals src[0..litlen) followed by match (offset, mlen), mlen == 0 for the last one
+static int lz_put_seq(unsigned char *dst, int op, int cap, const unsigned char *lit, int litlen, int offset, int mlen)
+{
+  int tok_lit = (litlen < 15)? litlen : 15;
+  int tok_match = 0;
+
+  if (mlen)
+    tok_match = (mlen - LZ_MIN_MATCH < 15)? mlen - LZ_MIN_MATCH : 15;
+
+  if (op >= cap)
+    return -1;
+  dst[op++] = (tok_lit << 4) | tok_match;
+
+  if (tok_lit == 15 && (op = lz_put_len(dst, op, cap, litlen - 15)) == -1)
+    return -1;
+
+  if (op + litlen > cap)
+    return -1;
+  memcpy(dst + op, lit, litlen);
+  op += litlen;
+
+  if (!mlen)
+    return op;
+
+  if (op + 2 > cap)
+    return -1;
+  dst[op++] = offset & 0xff;
+  dst[op++] = offset >> 8;
+
+  if (tok_match == 15 && (op = lz_put_len(dst, op, cap, mlen - LZ_MIN_MATCH - 15)) == -1)
+    return -1;
+
+  return op;
+}
+
+// compress n bytes of src into dst. Returns compressed size, -1 if it doesn't fit into cap
+int lz_compress(const unsigned char *src, int n, unsigned char *dst, int cap)
+{
+  int htab[1 << LZ_HASH_BITS];
+  int ip = 0, anchor = 0, op = 0;
+  int h, ref, mlen;
+
+  memset(htab, -1, sizeof(htab));
+
+  while (ip + LZ_MIN_MATCH <= n)
+  {
+    h = lz_hash(lz_read32(src + ip));
+    ref = htab[h];
+    htab[h] = ip;
+
+    if (ref < 0 || ip - ref > LZ_MAX_OFFSET || lz_read32(src + ref) != lz_read32(src + ip))
+    {
+      ip++;
+      continue;
+    }
+
+    mlen = LZ_MIN_MATCH;
+    while (ip + mlen < n && src[ref + mlen] == src[ip + mlen])
+      mlen++;
+
+    op = lz_put_seq(dst, op, cap, src + anchor, ip - anchor, ip - ref, mlen);
+    if (op == -1)
+      return -1;
+
+    ip += mlen;
+    anchor = ip;
+  }
+
+  return lz_put_seq(dst, op, cap, src + anchor, n - anchor, 0, 0);
+}
+
+// read length continuation bytes, -1 on truncated input
+static int lz_get_len(const unsigned char *src, int n, int *ip)
+{
+  int len = 0, b;
+
+  do
+  {
+    if (*ip >= n)
+      return -1;
+    b = src[(*ip)++];
+    len += b;
+  } while (b == 255);
+
+  return len;
+}
+
+// decompress n bytes of src into dst. Returns decompressed size, -1 on corrupted input
+int lz_decompress(const unsigned char *src, int n, unsigned char *dst, int cap)
+{
+  int ip = 0, op = 0;
+  int token, litlen, mlen, offset, extra;
+
+  while (ip < n)
+  {
+    token = src[ip++];
+
+    litlen = token >> 4;
+    if (litlen == 15)
+    {
+      if ((extra = lz_get_len(src, n, &ip)) == -1)
+        return -1;
+      litlen += extra;
+    }
+
+    if (ip + litlen > n || op + litlen > cap)
+      return -1;
+    memcpy(dst + op, src + ip, litlen);
+    ip += litlen;
+    op += litlen;
+
+    // last sequence has no match part
+    if (ip == n)
+      break;
+
+    if (ip + 2 > n)
+      return -1;
+    offset = src[ip] | (src[ip+1] << 8);
+    ip += 2;
+
+    mlen = token & 15;
+    if (mlen == 15)
+    {
+      if ((extra = lz_get_len(src, n, &ip)) == -1)
+        return -1;
+      mlen += extra;
+    }
+    mlen += LZ_MIN_MATCH;
+
+    if (offset == 0 || offset > op || op + mlen > cap)
+      return -1;
+
+    // byte by byte, match may overlap its own output
+    while (mlen--)
+    {
+      dst[op] = dst[op - offset];
+      op++;
+    }
+  }
+
+  return op;
+}
+
+static void lz_put32(unsigned char *p, uint32_t v)
+{
+  memcpy(p, &v, 4);
+}
+
+// compress whole file into LZ file at dst_path
+int lz_compress_file(const char *src_path, const char *dst_path)
+{
+  static unsigned char raw[LZ_BLOCK_SIZE];
+  static unsigned char comp[LZ_BOUND(LZ_BLOCK_SIZE) + 8];
+  FILE *in, *out;
+  int n, clen, res = 0;
+
+  in = fopen(src_path, "r");
+  if (!in)
+    return -1;
+
+  out = fopen(dst_path, "w");
+  if (!out)
+  {
+    fclose(in);
+    return -1;
+  }
+
+  fwrite(LZ_MAGIC, 4, 1, out);
+
+  while ((n = fread(raw, 1, LZ_BLOCK_SIZE, in)) > 0)
+  {
+    clen = lz_compress(raw, n, comp + 8, LZ_BOUND(LZ_BLOCK_SIZE));
+
+    lz_put32(comp, n);
+    if (clen == -1 || clen >= n)
+    {
+      // incompressible, store as is
+      lz_put32(comp + 4, n);
+      memcpy(comp + 8, raw, n);
+      clen = n;
+    }
+    else
+      lz_put32(comp + 4, clen);
+
+    if (fwrite(comp, clen + 8, 1, out) != 1)
+    {
+      res = -1;
+      break;
+    }
+  }
+
+  fclose(in);
+  if (fclose(out) != 0)
+    res = -1;
+
+  return res;
+}
+
+// read file calling cb() with chunks of its (decompressed if needed) contents, plain files are read as is
+int lz_read_file(const char *path, void (*cb)(const char *buf, int len, void *arg), void *arg)
+{
+  static unsigned char raw[LZ_BLOCK_SIZE];
+  static unsigned char comp[LZ_BOUND(LZ_BLOCK_SIZE)];
+  unsigned char hdr[8];
+  uint32_t rlen, clen;
+  FILE *in;
+  int n, res = 0;
+
+  in = fopen(path, "r");
+  if (!in)
+    return -1;
+
+  n = fread(raw, 1, 4, in);
+  if (n < 4 || memcmp(raw, LZ_MAGIC, 4) != 0)
+  {
+    // not compressed - pass through
+    if (n > 0)
+      cb((char*)raw, n, arg);
+    while ((n = fread(raw, 1, LZ_BLOCK_SIZE, in)) > 0)
+      cb((char*)raw, n, arg);
+
+    fclose(in);
+    return 0;
+  }
+
+  while (fread(hdr, 8, 1, in) == 1)
+  {
+    rlen = lz_read32(hdr);
+    clen = lz_read32(hdr + 4);
+
+    if (rlen > LZ_BLOCK_SIZE || clen > rlen || fread(comp, clen, 1, in) != 1)
+    {
+      res = -1;
+      break;
+    }
+
+    if (clen == rlen)
+      memcpy(raw, comp, rlen);
+    else if (lz_decompress(comp, clen, raw, LZ_BLOCK_SIZE) != (int)rlen)
+    {
+      res = -1;
+      break;
+    }
+
+    cb((char*)raw, rlen, arg);
+  }
+
+  fclose(in);
+  return res;
+}
@@ -0,0 +1,31 @@
+#ifndef LZ_H_INCLUDED
+#define LZ_H_INCLUDED
+
+// small LZ4-class block compressor for rotated log segments
+//
+// file:   "FZLZ" magic, then blocks of  <u32 raw_len> <u32 data_len> <data>,
+//         data_len == raw_len means block is stored uncompressed
+// block:  sequences of  <token> [lit len+] <literals> [<u16 offset> [match len+]],
+//         token high nibble is literal length, low nibble is match length - LZ_MIN_MATCH,
+//         15 in a nibble means more length bytes follow (255 - continue). Last sequence has literals only.
+
+#define LZ_MAGIC         "FZLZ"
+#define LZ_BLOCK_SIZE    (64*1024)
+#define LZ_BOUND(n)      ((n) + (n)/255 + 16)   // worst case compressed size of n bytes
+#define LZ_MIN_MATCH     4
+#define LZ_MAX_OFFSET    65535
+#define LZ_HASH_BITS     12
+
+// compress n bytes of src into dst. Returns compressed size, -1 if it doesn't fit into cap
+int  lz_compress(const unsigned char *src, int n, unsigned char *dst, int cap);
+
+// decompress n bytes of src into dst. Returns decompressed size, -1 on corrupted input
+int  lz_decompress(const unsigned char *src, int n, unsigned char *dst, int cap);
+
+// compress whole file into LZ file at dst_path
+int  lz_compress_file(const char *src_path, const char *dst_path);
+
+// read file calling cb() with chunks of its (decompressed if needed) contents, plain files are read as is
+int  lz_read_file(const char *path, void (*cb)(const char *buf, int len, void *arg), void *arg);
+
+#endif // LZ_H_INCLUDED
@@ -2,4 +2,5 @@
 
 mkdir log
 mkdir pid
-gcc -g -Wall syscall_def.c sandbox.c fuzzer.c -o  fuzzer
+gcc -g -Wall syscall_def.c sandbox.c campaign.c kmsg.c reslimit.c profile.c lz.c fuzzer.c -o  fuzzer
+gcc -g -Wall lz.c logcat.c -o  logcat
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+
+#include "profile.h"
+
+static unsigned int  prof_weight[SYSCALL_NUM];
+static int           prof_batch_len[SYSCALL_NUM];    // 0 - use caller's default
+
+// alias table (Vose): column i is taken with probability prof_prob[i]/(RAND_MAX+1), otherwise prof_alias[i]
+static long          prof_prob[SYSCALL_NUM];
+static int           prof_alias[SYSCALL_NUM];
+static int           prof_empty = 1;                 // all weights are zero
+
+// identity of the last loaded file, to notice edits cheaply
+static int           prof_loaded = 0;
+static struct timespec prof_mtim;
+static off_t         prof_size;
+static ino_t         prof_ino;
+
+static const char* profile_path()
+{
+  const char *path = getenv(PROFILE_ENV);
+  return (path && path[0])? path : PROFILE_FILE;
+}
+
+// build alias table from prof_weight[]
+static void profile_build_alias()
+{
+  double p[SYSCALL_NUM];
+  int small[SYSCALL_NUM], large[SYSCALL_NUM];
+  int nsmall = 0, nlarge = 0;
+  double total = 0;
+  int i, s, l;
+
+  for (i=0; i<SYSCALL_NUM; i++)
+    total += prof_weight[i];
+
+  prof_empty = (total == 0);
+  if (prof_empty)
+    return;
+
+  // scale so average column probability is 1
+  for (i=0; i<SYSCALL_NUM; i++)
+  {
+    p[i] = prof_weight[i] * SYSCALL_NUM / total;
+    prof_alias[i] = i;
+    if (p[i] < 1.0)
+      small[nsmall++] = i;
+    else
+      large[nlarge++] = i;
+  }
+
+  // each small column is topped up from a large one
+  while (nsmall && nlarge)
+  {
+    s = small[--nsmall];
+    l = large[--nlarge];
+
+    prof_prob[s] = (long)(p[s] * ((double)RAND_MAX + 1));
+    prof_alias[s] = l;
+
+    p[l] -= 1.0 - p[s];
+    if (p[l] < 1.0)
+      small[nsmall++] = l;
+    else
+      large[nlarge++] = l;
+  }
+
+  // leftovers are 1.0 up to rounding errors
+  while (nlarge)
+    prof_prob[large[--nlarge]] = (long)RAND_MAX + 1;
+  while (nsmall)
+    prof_prob[small[--nsmall]] = (long)RAND_MAX + 1;
+}
+
+// parse profile file, uniform weights if it can't be read
+static void profile_load(const char *path)
+{
+  FILE *f;
+  char line[256], name[64];
+  int i, weight, len, n, any;
+  char listed[SYSCALL_NUM];     // set by its own line, "*" leaves it alone
+
+  for (i=0; i<SYSCALL_NUM; i++)
+  {
+    prof_weight[i] = 1;
+    prof_batch_len[i] = 0;
+    listed[i] = 0;
+  }
+
+  f = fopen(path, "r");
+  if (f)
+  {
+    while (fgets(line, sizeof(line), f))
+    {
+      len = 0;
+      n = sscanf(line, "%63s %d %d", name, &weight, &len);
+      if (n < 2 || name[0] == '#')
+        continue;
+
+      if (weight < 0)
+        weight = 0;
+      if (weight > PROFILE_MAX_WEIGHT)
+        weight = PROFILE_MAX_WEIGHT;
+      if (len < 0)
+        len = 0;
+
+      any = (strcmp(name, "*") == 0);
+
+      for (i=0; i<SYSCALL_NUM; i++)
+      {
+        if (any && listed[i])
+          continue;
+
+        // "SYS_write" and plain "write" are both fine
+        if (any || strcmp(name, fuzzer_call_spec_list[i].name) == 0 || strcmp(name, fuzzer_call_spec_list[i].name + 4) == 0)
+        {
+          prof_weight[i] = weight;
+          prof_batch_len[i] = len;
+          listed[i] = !any;
+        }
+      }
+    }
+    fclose(f);
+  }
+
+  profile_build_alias();
+}
+
+// re-read profile if file was changed (or removed) since last call. Returns 1 if profile was reloaded
+int profile_reload()
+{
+  const char *path = profile_path();
+  struct stat st;
+
+  if (stat(path, &st) == -1)
+  {
+    // no profile at all - uniform weights, built once
+    if (prof_loaded != -1)
+    {
+      profile_load(path);
+      prof_loaded = -1;
+      return 1;
+    }
+    return 0;
+  }
+
+  if (prof_loaded == 1 && st.st_mtim.tv_sec == prof_mtim.tv_sec && st.st_mtim.tv_nsec == prof_mtim.tv_nsec
+      && st.st_size == prof_size && st.st_ino == prof_ino)
+    return 0;
+
+  profile_load(path);
+  prof_loaded = 1;
+  prof_mtim = st.st_mtim;
+  prof_size = st.st_size;
+  prof_ino = st.st_ino;
+
+  return 1;
+}
+
+// pick index in fuzzer_call_spec_list by weight, O(1). -1 if all weights are zero
+int profile_pick()
+{
+  int i;
+
+  if (prof_empty)
+    return -1;
+
+  i = rand() % SYSCALL_NUM;
+  return (rand() < prof_prob[i])? i : prof_alias[i];
+}
+
+int profile_weight(int idx)
+{
+  return (idx >= 0 && idx < SYSCALL_NUM)? prof_weight[idx] : 0;
+}
+
+// batch length for syscall `idx`, `def` if profile doesn't specify it
+int profile_batch_len(int idx, int def)
+{
+  if (idx < 0 || idx >= SYSCALL_NUM || prof_batch_len[idx] == 0)
+    return def;
+
+  return prof_batch_len[idx];
+}
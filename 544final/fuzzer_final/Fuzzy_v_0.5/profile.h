@@ -0,0 +1,29 @@
+#ifndef PROFILE_H_INCLUDED
+#define PROFILE_H_INCLUDED
+
+#include "syscall_def.h"
+
+// syscall weight profile, re-read by workers whenever it changes. Path may be overridden with
+// FUZZER_PROFILE env var, e.g. /dev/shm/fuzzer.profile to edit it in shared memory.
+//
+// one syscall per line:  <name> <weight> [batch length]
+//   SYS_write  10 5      - write is picked 10 times as often as weight 1 syscalls, 5 calls per batch
+//   *          0         - all syscalls not listed, wherever the line is (without it they get weight 1
+//                           and the caller's batch length)
+//   # comment
+#define PROFILE_FILE          "./profile.txt"
+#define PROFILE_ENV           "FUZZER_PROFILE"
+#define PROFILE_MAX_WEIGHT    1000000
+
+// re-read profile if file was changed (or removed) since last call. Returns 1 if profile was reloaded
+int  profile_reload();
+
+// pick index in fuzzer_call_spec_list by weight, O(1). -1 if all weights are zero
+int  profile_pick();
+
+int  profile_weight(int idx);
+
+// batch length for syscall `idx`, `def` if profile doesn't specify it
+int  profile_batch_len(int idx, int def);
+
+#endif // PROFILE_H_INCLUDED
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/resource.h>
+
+#include "fuzzer.h"
+#include "reslimit.h"
+
+static int cgroup_ok = 0;
+static char io_dev[32] = "";    // "maj:min" of the disk holding SANDBOX_DIR, empty if unknown
+
+// write string to cgroup control file
+static int reslimit_write(const char *path, const char *val)
+{
+  int fd, res;
+
+  fd = open(path, O_WRONLY);
+  if (fd == -1)
+    return -1;
+
+  res = write(fd, val, strlen(val));
+  close(fd);
+
+  return (res == (int)strlen(val))? 0 : -1;
+}
+
+// write controllers of CGROUP_CONTROLLERS to `path` one by one, returns how many were enabled
+static int reslimit_enable(const char *path)
+{
+  char ctl[] = CGROUP_CONTROLLERS;
+  char *tok, *save;
+  int ok = 0;
+
+  for (tok = strtok_r(ctl, " ", &save); tok; tok = strtok_r(NULL, " ", &save))
+  {
+    if (reslimit_write(path, tok) == 0)
+      ok++;
+  }
+
+  return ok;
+}
+
+// io.max takes whole disks only, so resolve sandbox partition to its parent disk
+static void reslimit_find_io_dev()
+{
+  struct stat st;
+  char path[128];
+  FILE *f;
+  unsigned int maj, min;
+
+  if (stat(SANDBOX_DIR, &st) == -1)
+    return;
+
+  maj = major(st.st_dev);
+  min = minor(st.st_dev);
+
+  sprintf(path, "/sys/dev/block/%u:%u/partition", maj, min);
+  if (access(path, F_OK) == 0)
+  {
+    sprintf(path, "/sys/dev/block/%u:%u/../dev", maj, min);
+    f = fopen(path, "r");
+    if (!f)
+      return;
+    if (fscanf(f, "%u:%u", &maj, &min) != 2)
+    {
+      fclose(f);
+      return;
+    }
+    fclose(f);
+  }
+
+  // not a block device (tmpfs, overlay...) - nothing to throttle
+  sprintf(path, "/sys/dev/block/%u:%u", maj, min);
+  if (access(path, F_OK) != 0)
+    return;
+
+  sprintf(io_dev, "%u:%u", maj, min);
+}
+
+// create fuzzer cgroup and enable controllers for worker leaves. Main process, before forking workers
+int reslimit_cgroup_init()
+{
+  cgroup_ok = 0;
+
+  if (mkdir(CGROUP_FUZZER, 0755) == -1 && errno != EEXIST)
+    return -1;
+
+  // controllers must be enabled on every level down to the leaves. Kernel may lack some of them
+  // (or delegate only some), the rest is still worth having
+  if (reslimit_enable(CGROUP_ROOT "/cgroup.subtree_control") == 0)
+    return -1;
+  if (reslimit_enable(CGROUP_FUZZER "/cgroup.subtree_control") == 0)
+    return -1;
+
+  reslimit_find_io_dev();
+  cgroup_ok = 1;
+
+  return 0;
+}
+
+// create/configure leaf of worker `id` and move `pid` into it
+int reslimit_cgroup_place(int id, pid_t pid)
+{
+  char leaf[64], path[128], val[128];
+  int res = 0;
+
+  if (!cgroup_ok)
+    return -1;
+
+  // leaf is kept between worker restarts, limits are rewritten anyway
+  sprintf(leaf, CGROUP_FUZZER "/worker_%d", id);
+  if (mkdir(leaf, 0755) == -1 && errno != EEXIST)
+    return -1;
+
+  sprintf(path, "%s/memory.max", leaf);
+  sprintf(val, "%lu", WORKER_MEM_MAX);
+  res |= reslimit_write(path, val);
+
+  sprintf(path, "%s/pids.max", leaf);
+  sprintf(val, "%d", WORKER_PIDS_MAX);
+  res |= reslimit_write(path, val);
+
+  if (io_dev[0])
+  {
+    sprintf(path, "%s/io.max", leaf);
+    sprintf(val, "%s rbps=%lu wbps=%lu", io_dev, WORKER_IO_RBPS, WORKER_IO_WBPS);
+    res |= reslimit_write(path, val);
+  }
+
+  sprintf(path, "%s/cgroup.procs", leaf);
+  sprintf(val, "%d", pid);
+  res |= reslimit_write(path, val);
+
+  return res;
+}
+
+// apply rlimits to calling worker process
+int reslimit_apply_rlimits()
+{
+  struct rlimit rl;
+  int res = 0;
+
+  rl.rlim_cur = rl.rlim_max = WORKER_FSIZE_MAX;
+  res |= setrlimit(RLIMIT_FSIZE, &rl);
+
+  rl.rlim_cur = rl.rlim_max = WORKER_NOFILE_MAX;
+  res |= setrlimit(RLIMIT_NOFILE, &rl);
+
+  return res;
+}
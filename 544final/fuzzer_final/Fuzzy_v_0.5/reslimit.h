@@ -0,0 +1,29 @@
+#ifndef RESLIMIT_H_INCLUDED
+#define RESLIMIT_H_INCLUDED
+
+#include <sys/types.h>
+
+// cgroup v2: every worker runs in its own leaf CGROUP_FUZZER/worker_<id>
+#define CGROUP_ROOT          "/sys/fs/cgroup"
+#define CGROUP_FUZZER        CGROUP_ROOT "/fuzzer"
+#define CGROUP_CONTROLLERS   "+memory +pids +io"
+
+#define WORKER_MEM_MAX       (256UL*1024*1024)   // memory.max, bytes
+#define WORKER_PIDS_MAX      32                  // pids.max
+#define WORKER_IO_RBPS       (32UL*1024*1024)    // io.max for the sandbox disk, bytes per second
+#define WORKER_IO_WBPS       (16UL*1024*1024)
+
+// setrlimit() inside the worker, fuzzed write/creat get EFBIG/EMFILE instead of filling the disk
+#define WORKER_FSIZE_MAX     (64UL*1024*1024)    // RLIMIT_FSIZE, bytes
+#define WORKER_NOFILE_MAX    256                 // RLIMIT_NOFILE, fd pool + logs fit well below
+
+// create fuzzer cgroup and enable controllers for worker leaves. Main process, before forking workers
+int  reslimit_cgroup_init();
+
+// create/configure leaf of worker `id` and move `pid` into it
+int  reslimit_cgroup_place(int id, pid_t pid);
+
+// apply rlimits to calling worker process
+int  reslimit_apply_rlimits();
+
+#endif // RESLIMIT_H_INCLUDED
@@ -5,6 +5,7 @@
 
 #include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/sysmacros.h>
 #include <unistd.h>
 
 #include <fcntl.h>
@@ -22,6 +23,8 @@
 
 #include "sandbox.h"
 
+char sandbox[SANDBOX_REGION_NUM][SANDBOX_REGION_SIZE];
+
 static char callback_path_tmp[PATH_MAX];
 static int  callback_fuz_arg;
 
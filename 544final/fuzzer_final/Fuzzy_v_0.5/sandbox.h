@@ -1,10 +1,9 @@
 #ifndef SANDBOX_H_INCLUDED
 #define SANDBOX_H_INCLUDED
 
+#include "fuzzer.h"
 #include "syscall_def.h"
 
-#define SANDBOX_DIR  "./sandbox"    // related to current (returned by pwd)
-
 #define SANDBOX_REGION_NUM    3                   // max number of arguments for fuzzing per call
 #define SANDBOX_REGION_SIZE   MAX_ULONG_BUFSIZE   // to be sure we can safely place biggest arg (like file path, buffer) + some safety space
 
@@ -14,7 +13,7 @@
 #define PROB_STR_NONASCII	    5  // percents
 
 // each process will obtain it's own copy of sandbox, so don't need to care about access safety
-char sandbox[SANDBOX_REGION_NUM][SANDBOX_REGION_SIZE];
+extern char sandbox[SANDBOX_REGION_NUM][SANDBOX_REGION_SIZE];
 
 #define FD_STATE_CLOSED    128
 
@@ -15,3 +15,20 @@ const scall_desc*  get_scall_desc(int scid)
 
     return NULL;
 }
+
+// index of syscall in fuzzer_call_spec_list, -1 if not supported
+int get_scall_idx(int scid)
+{
+    int scidx;
+
+    if (scid < 0)
+      return -1;
+
+    for (scidx=0; scidx<SYSCALL_NUM; scidx++)
+    {
+        if (fuzzer_call_spec_list[scidx].scid == scid)
+            return scidx;
+    }
+
+    return -1;
+}
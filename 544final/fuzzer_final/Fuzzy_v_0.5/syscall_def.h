@@ -194,6 +194,7 @@ static const scall_desc fuzzer_call_spec_list[] =
 };
 
 const scall_desc*  get_scall_desc(int scid);
+int   get_scall_idx(int scid);
 void* sc_prepare_fuzzed_arg(int argno, int argtype);
 void  sanitize_args_for_call(int scid);
 
@@ -0,0 +1,168 @@
+/*
+cs544 Concurrency - small runtime shared by all the concur programs
+*/
+#define _POSIX_C_SOURCE 200112L
+
+#include <time.h>
+
+#include "rt.h"
+
+// base seed and how many threads have drawn a stream from it so far
+static uint64_t rng_seed = 0x9e3779b97f4a7c15ull;
+static uint64_t rng_streams = 0;
+
+// xorshift64* state of this thread, 0 until its first rt_rand()
+static __thread uint64_t rng_state;
+
+// splitmix64, spreads seed+stream number over the whole state
+static uint64_t mix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+void rt_srand(uint64_t seed)
+{
+	__atomic_store_n(&rng_seed, seed, __ATOMIC_RELAXED);
+	__atomic_store_n(&rng_streams, 0, __ATOMIC_RELAXED);
+	rng_state = 0;
+}
+
+uint32_t rt_rand(void)
+{
+	uint64_t x = rng_state;
+
+	if (x == 0)
+	{
+		uint64_t stream = __atomic_fetch_add(&rng_streams, 1, __ATOMIC_RELAXED);
+		x = mix(__atomic_load_n(&rng_seed, __ATOMIC_RELAXED) + stream * 0x632be59bd9b4e019ull);
+		if (x == 0)
+			x = 1;	// xorshift never leaves 0
+	}
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	rng_state = x;
+	return (x * 0x2545f4914f6cdd1dull) >> 32;
+}
+
+int rt_range(int start, int end)
+{
+	uint64_t span = (uint64_t)((int64_t)end - start + 1);
+	return start + (int)((rt_rand() * span) >> 32);
+}
+
+// busy_work() loop iterations per microsecond
+static uint64_t spins_per_us = 100;
+
+uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+static void spin(uint64_t n)
+{
+	for (volatile uint64_t i = 0; i < n; i++)
+		;
+}
+
+void calibrate(void)
+{
+	uint64_t n = 1000000;
+	uint64_t t0, t1;
+
+	// grow the loop until it takes long enough to time reliably
+	for (;;)
+	{
+		t0 = now_ns();
+		spin(n);
+		t1 = now_ns();
+		if (t1 - t0 > 20000000)
+			break;
+		n *= 2;
+	}
+	spins_per_us = n * 1000 / (t1 - t0);
+	if (spins_per_us == 0)
+		spins_per_us = 1;
+}
+
+void busy_work(uint64_t ns)
+{
+	spin(ns * spins_per_us / 1000);
+}
+
+// bucket is (position of the top bit, next HIST_SUB_BITS bits below it)
+static int hist_bucket(uint64_t v)
+{
+	if (v < (1 << HIST_SUB_BITS))
+		return v;
+
+	int top = 63 - __builtin_clzll(v);
+	int sub = (v >> (top - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1);
+	return ((top - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + sub;
+}
+
+// smallest value of the next bucket, i.e. upper bound of bucket `i`
+static uint64_t hist_bucket_top(int i)
+{
+	if (i < (1 << HIST_SUB_BITS))
+		return i + 1;
+
+	int top = (i >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+	uint64_t sub = i & ((1 << HIST_SUB_BITS) - 1);
+	return ((1ull << HIST_SUB_BITS) + sub + 1) << (top - HIST_SUB_BITS);
+}
+
+void hist_add(struct hist *h, uint64_t v)
+{
+	h->b[hist_bucket(v)]++;
+	h->count++;
+	if (v > h->max)
+		h->max = v;
+}
+
+void hist_add_atomic(struct hist *h, uint64_t v)
+{
+	uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+	__atomic_add_fetch(&h->b[hist_bucket(v)], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+	while (v > max && !__atomic_compare_exchange_n(&h->max, &max, v, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+void hist_merge(struct hist *dst, const struct hist *src)
+{
+	for (int i = 0; i < HIST_BUCKETS; i++)
+		dst->b[i] += src->b[i];
+	dst->count += src->count;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+uint64_t hist_percentile(const struct hist *h, double p)
+{
+	uint64_t want = (uint64_t)(h->count * p / 100.0);
+	uint64_t seen = 0;
+
+	if (h->count == 0)
+		return 0;
+
+	for (int i = 0; i < HIST_BUCKETS; i++)
+	{
+		seen += h->b[i];
+		if (seen > want)
+		{
+			// the first buckets hold one value each, no need to round up
+			if (i < (1 << HIST_SUB_BITS))
+				return i;
+			uint64_t top = hist_bucket_top(i);
+			return (top > h->max)? h->max : top;
+		}
+	}
+	return h->max;
+}
@@ -0,0 +1,47 @@
+/*
+cs544 Concurrency - small runtime shared by all the concur programs
+
+Per-thread random numbers (libc's rand() takes a lock, so threads calling
+it all the time end up taking turns), monotonic nanosecond clock,
+calibrated busy-work to stand in for the sleep() calls, and a log-linear
+latency histogram (8 sub-buckets per power of two, so percentiles are
+within ~12%).
+*/
+#ifndef RT_H
+#define RT_H
+
+#include <stdint.h>
+
+#define HIST_SUB_BITS 3
+#define HIST_BUCKETS (64 << HIST_SUB_BITS)
+
+struct hist
+{
+	uint64_t count;
+	uint64_t max;
+	uint64_t b[HIST_BUCKETS];
+};
+
+// seed for every thread's generator, call once at start like srand().
+// Each thread gets its own stream derived from this seed
+void rt_srand(uint64_t seed);
+// next number of the calling thread's stream, 0..2^32-1
+uint32_t rt_rand(void);
+// random number in start..end, both included
+int rt_range(int start, int end);
+
+uint64_t now_ns(void);
+
+// measure how fast busy_work() spins on this machine, call once at start
+void calibrate(void);
+// burn about `ns` nanoseconds of cpu without any syscall
+void busy_work(uint64_t ns);
+
+void hist_add(struct hist *h, uint64_t v);
+// same, for a histogram several threads add to
+void hist_add_atomic(struct hist *h, uint64_t v);
+void hist_merge(struct hist *dst, const struct hist *src);
+// value below which `p` percent of samples fall
+uint64_t hist_percentile(const struct hist *h, double p);
+
+#endif
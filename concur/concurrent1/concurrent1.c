@@ -6,167 +6,592 @@ Group 26 Li Li, Hafed Alghamdi, Sultan AlAnazi
 Oct 14 2014
 
 */
+#define _GNU_SOURCE
+
+#include <errno.h>
 #include <pthread.h>
-#include <semaphore.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
 
-// two semaphores, one for consumers and on for producers
+#include "shard.h"
+#include "rt.h"
+
+// default number of buffer slots
+#define CAPACITY 32
+
+// benchmark mode defaults
+#define BENCH_DURATION 2	// seconds per grid point
+#define BENCH_WORK_NS 1000	// busy-work per produced/consumed item
+#define BENCH_MAX_THREADS 32	// grid goes 1,2,4.. up to this many producers and consumers
+
+// byte ring mode: messages are sizeof(struct item)..MSG_MAX_LEN bytes
+#define MSG_MAX_LEN 64
+
+// queue depth is sampled this often, SIGUSR1 is picked up at the same pace
+#define DEPTH_SAMPLE_NS 1000000
 
-sem_t sem_c;
-sem_t sem_p;
+// items are passed through lock-free rings, producers and consumers
+// move them in batches and only block when the ring is full/empty.
+// One ring shared by everybody, or in sharded mode one per consumer
+struct shards buff;
 
-// item struct
-struct item
+// byte ring mode: variable-size messages, written and read in place
+struct bring bbuf;
+uint32_t max_len = MSG_MAX_LEN;
+
+// which engine(s) to run, the benchmark can run all of them for each grid point
+#define MODE_RING 1
+#define MODE_SHARD 2
+#define MODE_BYTES 4
+#define MODE_ALL (MODE_RING | MODE_SHARD | MODE_BYTES)
+int cur_mode;
+
+// benchmark mode: busy-work instead of sleeps, run until `stop` is set
+int bench = 0;
+uint64_t work_ns = BENCH_WORK_NS;
+int stop = 0;
+// items moved per produce_n/consume_n call
+int batch = 1;
+
+// what each pool thread gets: its number and how many items to move,
+// consumers give back how many they took and the latency histogram
+struct worker_arg
 {
-	int a;
-	int b;
-}buff[32];
+	int id;
+	int home;	// shard it pushes to/pops from first
+	int count;
+	long done;
+	struct hist lat;
+	struct ring_stats st;	// time blocked on full/empty
+};
 
+// what a run gives back: enqueue-to-dequeue latency, how deep the
+// ring(s) got, and how long threads spent blocked on full/empty
+struct run_stats
+{
+	unsigned capacity;	// per ring as allocated, -q is rounded up; largest messages for bytes
+	long done;
+	double secs;
+	struct hist lat;
+	struct hist depth;
+	uint64_t full_ns;	// summed over producers
+	uint64_t empty_ns;	// summed over consumers
+};
 
-// producer items, it has two semaphores in it.
-// sem_c for number of items that we currently have and sem_p for
-// number of space in buff we have. So before producing, we check if
-// sem_p have anything space left to produce, if we have than we decrease 
-// the space and produce. After producing, we increase the number of items-- sem_c.
+// the sampler thread's view of the run in progress
+struct sampler_arg
+{
+	int no_p;
+	int no_c;
+	struct worker_arg *p_args;
+	struct worker_arg *c_args;
+	struct run_stats *rs;
+	uint64_t t0;
+	int quit;
+};
+
+
+// producer items. Every `batch` items go into the ring with one
+// produce_n(): one CAS claims the slots and at most one wakeup goes
+// to a sleeping consumer, instead of a sem_wait/sem_post per item.
+// produce_n() blocks while the ring is full. In sharded mode the items
+// go to the producer's home shard, or spill over to the others.
 void *producers(void* arg)
 {
-	int pro_no = *((int*)arg);
+	struct worker_arg *wa = arg;
+	int pro_no = wa->count;
+	struct item *its = malloc(sizeof(struct item)*batch);
+
+	ring_stats_bind(&wa->st);
 	
-	for(int cnt=0;cnt<pro_no;cnt++)
+	for(int cnt=0;bench? !__atomic_load_n(&stop, __ATOMIC_RELAXED) : cnt<pro_no;cnt+=batch)
 	{
-		fprintf(stderr, "producer is running\n");
-		//sem_c++, sem_p--
-		int val;
-		
-		if(sem_getvalue(&sem_p, &val)==-1)
-			fprintf(stderr, "semget err\n");
-		if (val==0)
-			fprintf(stderr, "producer is blocked\n");
-		sem_wait(&sem_p);
-		// 
-		for(int i =0;i<32;i++)
-		{
-			if(buff[i].b== 0 )
-				{
-				//ACM code randm()
-				
-				int rd1;
-				//int rd1 = 3+rand()%6;
-		__asm__(
-					"movl	$0, %eax\n\t"
-					"call	rand\n\t"
-					"movl	%eax, -12(%rbp)\n\t"
-
-				);
-				
-				//fprintf(stderr, "%d\n",rd1);
-				rd1 = 3+ rd1%6;
+		if (!bench)
+			fprintf(stderr, "producer is running\n");
+
+		int n = batch;
+		if (!bench && pro_no-cnt < n)
+			n = pro_no-cnt;
 
+		for (int i=0; i<n; i++)
+		{
+			if (bench)
+				busy_work(work_ns);
+			else {
+				int rd1 = 3+rt_rand()%6;
 				sleep(rd1);
-				//
-				//int rd2 = rand()%10;
-				int rd2;
-		__asm__(
-					"movl	$0, %eax\n\t"
-					"call	rand\n\t"
-					"movl	%eax, -8(%rbp)\n\t"
-
-				);
-				//fprintf(stderr, "%d\n",rd2);
-				rd2 = rd2%10;
-				
-				buff[i].a = rd2;
-				
-				//int rd3 = 2+rand()%8;
-				int rd3;
-		__asm__(
-					"movl	$0, %eax\n\t"
-					"call	rand\n\t"
-					"movl	%eax, -4(%rbp)\n\t"
-
-				);
-				//fprintf(stderr, "%d\n",rd3);
-				rd3 = 2+rd3%8;
-				buff[i].b = rd3;
-			
-				break;			
-				}
+			}
+			its[i].a = rt_rand()%10;
+			its[i].b = 2+rt_rand()%8;
 		}
-		
-		sem_post(&sem_c);
+
+		// latency starts when the batch goes in, not while it's filled
+		uint64_t t = now_ns();
+		for (int i=0; i<n; i++)
+			its[i].t = t;
+
+		// short only if the ring got closed at the end of a bench run
+		if (shards_push(&buff, wa->home, its, n) < (unsigned)n)
+			break;
 	}
+	free(its);
 	return 0;
 }
 
 
-// Consume items, like producers(), here we use both of the sem_c and sem_p too.
-// sem_c for number of items that we currently have and sem_p for
-// number of space in buff we have. So before consuming, we check if
-// sem_p have anything items left to consume, if we have than we decrease 
-// the number of items to consume. After consuming, we increase 
-// the number of space that we can produce.
+// Consume items, like producers() up to `batch` at a time. consume_n()
+// blocks while the ring is empty and returns 0 once the ring is closed
+// and drained, that's when the consumer is done. In sharded mode a
+// consumer owns one shard and steals from the others when it's empty.
 void *consumers(void* arg)
 {
-	int com_no = *((int*)arg);
+	struct worker_arg *wa = arg;
+	struct item *its = malloc(sizeof(struct item)*batch);
+
+	ring_stats_bind(&wa->st);
 	
-	for(int cnt=0;cnt<com_no;cnt++)
+	for(;;)
 	{
-		fprintf(stderr, "consumers running\n");
-	
-		//sem_c--, sem_p++
-		
-		int val;
-		
-		if(sem_getvalue(&sem_c, &val)==-1)
-			fprintf(stderr, "semget err\n");
-		if (val==0)
-			fprintf(stderr, "consumer is blocked\n");
-		sem_wait(&sem_c);
-	
-		// 
-		for(int i =0;i<32;i++)
+		if (!bench)
+			fprintf(stderr, "consumers running\n");
+
+		unsigned n = shards_pop(&buff, wa->home, its, batch);
+		if (n == 0)
+			break;
+
+		uint64_t t = now_ns();
+		for (unsigned i=0; i<n; i++)
 		{
-			if(buff[i].b!= 0)
-				{
-				fprintf(stderr, "%d\n",buff[i].a);
-				sleep(buff[i].b);
-				fprintf(stderr, "%d\n",buff[i].b);
-				buff[i].a = 0;
-				buff[i].b = 0;
-				break;			
-				}
+			// enqueue-to-dequeue latency
+			hist_add(&wa->lat, t - its[i].t);
+			wa->done++;
+
+			if (bench) {
+				busy_work(work_ns);
+				continue;
+			}
+			fprintf(stderr, "%d\n",its[i].a);
+			sleep(its[i].b);
+			fprintf(stderr, "%d\n",its[i].b);
+		}
+	}
+	free(its);
+	return 0;
+}
+
+// byte ring producer: a message is an item followed by filler, between
+// sizeof(struct item) and max_len bytes. It is built right in the ring
+// between bring_reserve() and bring_commit(), nothing is copied
+void *byte_producers(void* arg)
+{
+	struct worker_arg *wa = arg;
+	int pro_no = wa->count;
+
+	ring_stats_bind(&wa->st);
+
+	for(int cnt=0;bench? !__atomic_load_n(&stop, __ATOMIC_RELAXED) : cnt<pro_no;cnt++)
+	{
+		if (!bench)
+			fprintf(stderr, "producer is running\n");
+
+		// do the work first, a reserved message holds up everything behind it
+		if (bench)
+			busy_work(work_ns);
+		else
+			sleep(3+rt_rand()%6);
+
+		uint32_t len = rt_range(sizeof(struct item), max_len);
+		struct item *it = bring_reserve(&bbuf, len);
+		if (!it) {
+			// run() made room for max_len, so this would be a bug
+			if (errno == EMSGSIZE)
+				fprintf(stderr, "message of %u bytes doesn't fit in the ring\n", len);
+			break;	// closed at the end of a bench run
 		}
-		sem_post(&sem_p);
+
+		it->a = rt_rand()%10;
+		it->b = 2+rt_rand()%8;
+		memset(it+1, it->a, len - sizeof(struct item));
+		it->t = now_ns();
+		bring_commit(&bbuf, it);
+	}
+	return 0;
+}
+
+// byte ring consumer: checks the filler in place, then gives the space
+// back before sleeping on it
+void *byte_consumers(void* arg)
+{
+	struct worker_arg *wa = arg;
+	struct item *it;
+	uint32_t len;
+
+	ring_stats_bind(&wa->st);
+
+	while ((it = bring_view(&bbuf, &len)))
+	{
+		if (!bench)
+			fprintf(stderr, "consumers running\n");
+
+		hist_add(&wa->lat, now_ns() - it->t);
+		wa->done++;
+
+		unsigned char *fill = (unsigned char *)(it+1);
+		for (uint32_t i=0; i<len-sizeof(struct item); i++)
+			if (fill[i] != it->a) {
+				fprintf(stderr, "message corrupted at byte %zu\n", i+sizeof(struct item));
+				break;
+			}
+
+		int a = it->a, b = it->b;
+		bring_release(&bbuf, it);
+
+		if (bench) {
+			busy_work(work_ns);
+			continue;
+		}
+		fprintf(stderr, "%d\n",a);
+		sleep(b);
+		fprintf(stderr, "%d\n",b);
+	}
+	return 0;
+}
+
+// start `num` threads running `fn`, thread k is pinned to core (first+k) % cores
+// so producers and consumers are spread over all cores
+pthread_t *start_pool(int num, int first, void *(*fn)(void*), struct worker_arg *args)
+{
+	pthread_t *threads = malloc(sizeof(pthread_t)*num);
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	pthread_attr_t attr;
+	cpu_set_t cpus;
+
+	if (cores < 1)
+		cores = 1;
+
+	for (int i=0; i<num; i++)
+	{
+		pthread_attr_init(&attr);
+		CPU_ZERO(&cpus);
+		CPU_SET((first+i) % cores, &cpus);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+
+		if (pthread_create(&threads[i], &attr, fn, (void *)&args[i])) {
+			fprintf(stderr, "Error creating thread %d\n", first+i);
+			exit(EXIT_FAILURE);
+		}
+		pthread_attr_destroy(&attr);
+	}
+	return threads;
+}
+
+// blocked time and queue depth so far, at the end of a run or on SIGUSR1
+void report(struct sampler_arg *sa, FILE *f)
+{
+	double secs = (now_ns() - sa->t0)/1e9;
+	struct hist *depth = &sa->rs->depth;
+
+	if (cur_mode == MODE_BYTES)
+		fprintf(f, "bytes queued in a %llu byte ring, ", (unsigned long long)bbuf.size);
+	else
+		fprintf(f, "queue depth over %d ring(s) of %u slots, ", buff.n, buff.r[0].capacity);
+	fprintf(f, "%llu samples: p50 %llu p90 %llu p99 %llu max %llu\n", (unsigned long long)depth->count,
+		(unsigned long long)hist_percentile(depth, 50), (unsigned long long)hist_percentile(depth, 90),
+		(unsigned long long)hist_percentile(depth, 99), (unsigned long long)depth->max);
+
+	for (int i=0; i<sa->no_p; i++) {
+		struct ring_stats *st = &sa->p_args[i].st;
+		uint64_t ns = __atomic_load_n(&st->full_ns, __ATOMIC_RELAXED);
+		fprintf(f, "producer %d: blocked on full %llu times, %.3f s (%.1f%%)\n", i,
+			(unsigned long long)__atomic_load_n(&st->full_waits, __ATOMIC_RELAXED), ns/1e9, 100*ns/1e9/secs);
+	}
+	for (int i=0; i<sa->no_c; i++) {
+		struct ring_stats *st = &sa->c_args[i].st;
+		uint64_t ns = __atomic_load_n(&st->empty_ns, __ATOMIC_RELAXED);
+		fprintf(f, "consumer %d: blocked on empty %llu times, %.3f s (%.1f%%)\n", i,
+			(unsigned long long)__atomic_load_n(&st->empty_waits, __ATOMIC_RELAXED), ns/1e9, 100*ns/1e9/secs);
+	}
+	fflush(f);
+}
+
+// Samples the total number of queued items (bytes in byte ring mode)
+// every DEPTH_SAMPLE_NS. The
+// wait between samples is sigtimedwait() on SIGUSR1, which main keeps
+// blocked in every thread, so a SIGUSR1 at any time gets a report
+// without anybody's sleep() or futex_wait being interrupted
+void *sampler(void *arg)
+{
+	struct sampler_arg *sa = arg;
+	struct timespec ts = { 0, DEPTH_SAMPLE_NS };
+	sigset_t usr1;
+
+	sigemptyset(&usr1);
+	sigaddset(&usr1, SIGUSR1);
+
+	while (!__atomic_load_n(&sa->quit, __ATOMIC_RELAXED))
+	{
+		if (sigtimedwait(&usr1, NULL, &ts) == SIGUSR1)
+			report(sa, stderr);
+
+		uint64_t depth = 0;
+		if (cur_mode == MODE_BYTES)
+			depth = bring_used(&bbuf);
+		else
+			for (int i=0; i<buff.n; i++)
+				depth += ring_count(&buff.r[i]);
+		hist_add(&sa->rs->depth, depth);
 	}
 	return 0;
 }
 
+void close_buffer(int mode)
+{
+	if (mode == MODE_BYTES)
+		bring_close(&bbuf);
+	else
+		shards_close(&buff);
+}
+
+const char *mode_name(int mode)
+{
+	switch (mode)
+	{
+		case MODE_SHARD: return "shard";
+		case MODE_BYTES: return "bytes";
+		default: return "ring";
+	}
+}
+
+// one run of the engine: `items` per producer, or `duration` seconds in
+// benchmark mode. Results go into `rs`, the per-thread summary is
+// printed at the end unless in benchmark mode.
+// `capacity` is per ring, so sharded mode has no_c times the slots.
+// The byte ring holds `capacity` messages of the largest size, and at
+// least two: a message can take at most half of it
+void run(int mode, int no_p, int no_c, int items, int capacity, int duration, struct run_stats *rs)
+{
+	size_t bytes = (size_t)(capacity < 2? 2 : capacity) * (max_len + 8);
+
+	cur_mode = mode;
+	if (mode == MODE_BYTES? bring_init(&bbuf, bytes) :
+			shards_init(&buff, mode == MODE_SHARD? no_c : 1, capacity)) {
+		fprintf(stderr, "can't allocate buffer of %d items\n", capacity);
+		exit(EXIT_FAILURE);
+	}
+	if (mode == MODE_BYTES && bring_max(&bbuf) < max_len) {
+		fprintf(stderr, "messages of %u bytes don't fit in a ring of %zu\n", max_len, bytes);
+		exit(EXIT_FAILURE);
+	}
+	rs->capacity = mode == MODE_BYTES? bbuf.size / ((max_len + 8 + 7) & ~7u) : buff.r[0].capacity;
+
+	stop = 0;
+	
+	// every producer makes `items`, consumers take whatever comes
+	// until the ring is closed and empty
+	struct worker_arg *p_args = calloc(no_p, sizeof(struct worker_arg));
+	struct worker_arg *c_args = calloc(no_c, sizeof(struct worker_arg));
+
+	for (int i=0; i<no_p; i++) {
+		p_args[i].id = i;
+		p_args[i].home = (mode == MODE_BYTES)? 0 : shards_home(&buff, i, no_p);
+		p_args[i].count = items;
+	}
+	for (int i=0; i<no_c; i++) {
+		c_args[i].id = i;
+		c_args[i].home = (mode == MODE_BYTES)? 0 : i % buff.n;
+	}
+
+	uint64_t t0 = now_ns();
+
+	struct sampler_arg sa = { no_p, no_c, p_args, c_args, rs, t0, 0 };
+	pthread_t s_thread;
+	pthread_create(&s_thread, NULL, sampler, &sa);
+
+	pthread_t *p_threads = start_pool(no_p, 0, mode == MODE_BYTES? byte_producers : producers, p_args);
+	pthread_t *c_threads = start_pool(no_c, no_p, mode == MODE_BYTES? byte_consumers : consumers, c_args);
+
+	if (bench) {
+		sleep(duration);
+		__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+		// kick blocked producers out, consumers drain what's queued
+		close_buffer(mode);
+	}
+
+	for (int i=0; i<no_p; i++)
+		pthread_join(p_threads[i], NULL);
+	// all items are in, consumers leave once the ring is empty
+	close_buffer(mode);
+	for (int i=0; i<no_c; i++)
+		pthread_join(c_threads[i], NULL);
+
+	rs->secs = (now_ns() - t0)/1e9;
+
+	__atomic_store_n(&sa.quit, 1, __ATOMIC_RELAXED);
+	pthread_join(s_thread, NULL);
+	if (!bench)
+		report(&sa, stderr);
+
+	for (int i=0; i<no_p; i++)
+		rs->full_ns += p_args[i].st.full_ns;
+	for (int i=0; i<no_c; i++) {
+		rs->done += c_args[i].done;
+		rs->empty_ns += c_args[i].st.empty_ns;
+		hist_merge(&rs->lat, &c_args[i].lat);
+	}
+
+	free(p_threads);
+	free(c_threads);
+	free(p_args);
+	free(c_args);
+	if (mode == MODE_BYTES)
+		bring_destroy(&bbuf);
+	else
+		shards_destroy(&buff);
+}
+
+// benchmark mode: CSV line per producers x consumers grid point and mode.
+// full/empty_pct are the share of producer/consumer thread time spent
+// blocked, depth is the number of queued items over all rings
+void run_bench(int modes, int duration, int capacity, int max_threads)
+{
+	calibrate();
+	printf("mode,producers,consumers,capacity,batch,work_ns,seconds,items,items_per_sec,lat_p50_ns,lat_p90_ns,lat_p99_ns,lat_p999_ns,lat_max_ns,"
+		"depth_p50,depth_p99,depth_max,full_pct,empty_pct\n");
+
+	for (int np=1; np<=max_threads; np*=2)
+		for (int nc=1; nc<=max_threads; nc*=2)
+		for (int mode=MODE_RING; mode<=MODE_BYTES; mode<<=1)
+		{
+			if (!(modes & mode))
+				continue;
+
+			struct run_stats *rs = calloc(1, sizeof(struct run_stats));
+			run(mode, np, nc, 0, capacity, duration, rs);
+
+			struct hist *lat = &rs->lat;
+			printf("%s,%d,%d,%u,%d,%llu,%.3f,%ld,%.1f,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.1f,%.1f\n",
+				mode_name(mode), np, nc, rs->capacity, batch,
+				(unsigned long long)work_ns, rs->secs, rs->done, rs->done/rs->secs,
+				(unsigned long long)hist_percentile(lat, 50), (unsigned long long)hist_percentile(lat, 90),
+				(unsigned long long)hist_percentile(lat, 99), (unsigned long long)hist_percentile(lat, 99.9),
+				(unsigned long long)lat->max,
+				(unsigned long long)hist_percentile(&rs->depth, 50), (unsigned long long)hist_percentile(&rs->depth, 99),
+				(unsigned long long)rs->depth.max,
+				100*rs->full_ns/1e9/(rs->secs*np), 100*rs->empty_ns/1e9/(rs->secs*nc));
+			fflush(stdout);
+			free(rs);
+		}
+}
+
+void usage(char *name)
+{
+	printf("usage: %s [-n BATCH] [-s ring|shard|bytes] [-l MAX_LEN] NUM_PRODUCERS NUM_CONSUMERS ITEMS_PER_PRODUCER [CAPACITY]\n%s 4 4 10 32 is a good default\n", name, name);
+	printf("benchmark: %s -b [-d SECONDS] [-w WORK_NS] [-q CAPACITY] [-n BATCH] [-m MAX_THREADS] [-s ring|shard|both|bytes|all] [-l MAX_LEN]\n", name);
+	printf("  runs every producers x consumers pair in 1,2,4..MAX_THREADS for SECONDS each, prints CSV\n");
+	printf("  CAPACITY is rounded up to a power of two, the CSV has what was allocated\n");
+	printf("  -s shard: one ring of CAPACITY per consumer, with stealing\n");
+	printf("  -s bytes: messages of %zu..MAX_LEN bytes built and read in place, one at a time (no BATCH)\n", sizeof(struct item));
+	printf("  the benchmark runs all of them by default\n");
+}
+
 int main(int argc, char** argv)
 {
-	if (argc != 3) {
+	int capacity = CAPACITY;
+	int duration = BENCH_DURATION;
+	int max_threads = BENCH_MAX_THREADS;
+	int modes = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "bd:w:q:n:m:s:l:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'b': bench = 1; break;
+			case 'd': duration = atoi(optarg); break;
+			case 'w': work_ns = atoll(optarg); break;
+			case 'q': capacity = atoi(optarg); break;
+			case 'n': batch = atoi(optarg); break;
+			case 'm': max_threads = atoi(optarg); break;
+			case 'l':
+				// negative would wrap around to a huge max_len
+				if (atoi(optarg) < (int)sizeof(struct item)) {
+					fprintf(stderr, "messages are at least %zu bytes\n", sizeof(struct item));
+					exit(EXIT_FAILURE);
+				}
+				max_len = atoi(optarg);
+				break;
+			case 's':
+				if (!strcmp(optarg, "ring"))
+					modes = MODE_RING;
+				else if (!strcmp(optarg, "shard"))
+					modes = MODE_SHARD;
+				else if (!strcmp(optarg, "both"))
+					modes = MODE_RING | MODE_SHARD;
+				else if (!strcmp(optarg, "bytes"))
+					modes = MODE_BYTES;
+				else if (!strcmp(optarg, "all"))
+					modes = MODE_ALL;
+				else {
+					usage(argv[0]);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			default:
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	rt_srand(time(NULL));
+
+	// SIGUSR1 is only taken by the sampler thread, see sampler()
+	sigset_t usr1;
+	sigemptyset(&usr1);
+	sigaddset(&usr1, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &usr1, NULL);
+
+	if (bench) {
+		if (capacity <= 0 || duration <= 0 || max_threads <= 0 || batch <= 0) {
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+		run_bench(modes? modes : MODE_ALL, duration, capacity, max_threads);
+		return 0;
+	}
+
+	argc -= optind - 1;
+	argv += optind - 1;
+
+	if (argc != 4 && argc != 5) {
 		fprintf(stderr, "incorrect number of arguments\n");
-		printf("input two arguments:1. No. of producers \n 2. No. of consumers  \n");
+		usage(argv[0]);
 		exit(EXIT_FAILURE);
 	}
 	
-	srand(time(NULL));
-	
-	sem_init(&sem_c, 0, 0);
-	sem_init(&sem_p,0,32);
-	
-	pthread_t thread1, thread2;
-	
 	int no_p = atoi(argv[1]);
 	int no_c = atoi(argv[2]);
-	
-    pthread_create(&thread1, NULL, producers, (void *)&no_p);
-    pthread_create(&thread2, NULL, consumers, (void *)&no_c);
-    
-    pthread_join(thread1, NULL);
-    pthread_join(thread2, NULL);
-    
-    return 0;
-}
\ No newline at end of file
+	int items = atoi(argv[3]);
+	if (argc == 5)
+		capacity = atoi(argv[4]);
+
+	if (no_p <= 0 || no_c <= 0 || items < 0 || capacity <= 0 || batch <= 0) {
+		fprintf(stderr, "need at least one producer, one consumer and one slot\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (modes & (modes-1)) {
+		fprintf(stderr, "pick one of ring, shard or bytes\n");
+		exit(EXIT_FAILURE);
+	}
+	struct run_stats *rs = calloc(1, sizeof(struct run_stats));
+	run(modes? modes : MODE_RING, no_p, no_c, items, capacity, 0, rs);
+
+	printf("%d producers x %d consumers: %ld items in %.3f s, %.1f items/s\n", no_p, no_c, rs->done, rs->secs, rs->done/rs->secs);
+	free(rs);
+	return 0;
+}
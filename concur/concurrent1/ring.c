@@ -0,0 +1,784 @@
+/*
+cs544 Concurrency 1 - bounded lock-free ring buffer for items
+*/
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "ring.h"
+#include "rt.h"
+
+// waiting on a full/empty ring: check this many times with a pause in
+// between, then this many times with sched_yield(), then go to sleep
+#define RING_SPINS 128
+#define RING_YIELDS 8
+
+// how many rounds ring_close() waits for sleepers to leave a ring in
+// shared memory. A process that died asleep never will, so there it can't
+// be "until they're gone"; in-process sleepers always do leave
+#define RING_CLOSE_TRIES 1000
+
+// shared memory ring: header, the ring, then the slots. `magic` is set
+// last, attachers wait for it before touching anything else
+#define RING_SHM_MAGIC 0x52494e47u	// "RING"
+#define RING_SHM_TRIES 1000	// 1ms apart
+
+struct ring_shm
+{
+	uint32_t magic;
+	int producers;	// attached producers, the last one out closes the ring
+	uint64_t size;	// of the whole mapping
+	struct ring r;
+};
+
+// counters of the calling thread, NULL if it doesn't keep any
+static __thread struct ring_stats *tstats;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+
+// slots live at an offset from the ring rather than behind a pointer,
+// so a ring in shared memory works wherever each process maps it
+static inline struct ring_slot *slot_at(struct ring *r, uint64_t pos)
+{
+	return (struct ring_slot *)((char *)r + r->slots_off) + (pos & r->mask);
+}
+
+// common part of ring_init and ring_shm_open
+static void ring_setup(struct ring *r, struct ring_slot *slots, unsigned n, int futex_private)
+{
+	// every slot starts free for the first lap of producers
+	for (unsigned i = 0; i < n; i++)
+		slots[i].seq = i;
+
+	r->slots_off = (intptr_t)slots - (intptr_t)r;
+	r->futex_private = futex_private;
+	r->capacity = n;
+	r->mask = n - 1;
+	r->head = 0;
+	r->tail = 0;
+	r->closed = 0;
+	r->full_waiters = 0;
+	r->empty_waiters = 0;
+}
+
+int ring_init(struct ring *r, unsigned capacity)
+{
+	struct ring_slot *slots;
+	unsigned n = 1;
+
+	// n would wrap to 0 on the way up and never get there
+	if (capacity > RING_MAX_CAPACITY)
+		return -1;
+	while (n < capacity)
+		n <<= 1;
+
+	if (posix_memalign((void **)&slots, CACHE_LINE, sizeof(struct ring_slot) * n))
+		return -1;
+
+	ring_setup(r, slots, n, FUTEX_PRIVATE_FLAG);
+	return 0;
+}
+
+void ring_destroy(struct ring *r)
+{
+	free(slot_at(r, 0));
+	r->slots_off = 0;
+}
+
+// claim up to n slots from tail with one CAS: count how many slots in a
+// row the previous lap's consumers have released, take them all, then
+// fill and publish each one with its slot seq
+unsigned ring_try_push_n(struct ring *r, const struct item *it, unsigned n)
+{
+	uint64_t pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+	unsigned k;
+
+	for (;;)
+	{
+		int64_t diff = 0;
+
+		for (k = 0; k < n; k++)
+		{
+			uint64_t seq = __atomic_load_n(&slot_at(r, pos + k)->seq, __ATOMIC_ACQUIRE);
+			diff = (int64_t)seq - (int64_t)(pos + k);
+			if (diff != 0)
+				break;
+		}
+
+		if (k == 0)
+		{
+			if (diff < 0)
+				return 0;	// full, slot still owned by a consumer one lap behind
+			pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+			continue;
+		}
+		if (__atomic_compare_exchange_n(&r->tail, &pos, pos + k, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+	}
+
+	for (unsigned i = 0; i < k; i++)
+	{
+		struct ring_slot *slot = slot_at(r, pos + i);
+		slot->it = it[i];
+		__atomic_store_n(&slot->seq, pos + i + 1, __ATOMIC_RELEASE);
+	}
+	return k;
+}
+
+// mirror of ring_try_push_n: claim a run of published slots from head,
+// take the items and hand the slots to the next lap's producers
+unsigned ring_try_pop_n(struct ring *r, struct item *it, unsigned n)
+{
+	uint64_t pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	unsigned k;
+
+	for (;;)
+	{
+		int64_t diff = 0;
+
+		for (k = 0; k < n; k++)
+		{
+			uint64_t seq = __atomic_load_n(&slot_at(r, pos + k)->seq, __ATOMIC_ACQUIRE);
+			diff = (int64_t)seq - (int64_t)(pos + k + 1);
+			if (diff != 0)
+				break;
+		}
+
+		if (k == 0)
+		{
+			if (diff < 0)
+				return 0;	// empty
+			pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+			continue;
+		}
+		if (__atomic_compare_exchange_n(&r->head, &pos, pos + k, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+	}
+
+	for (unsigned i = 0; i < k; i++)
+	{
+		struct ring_slot *slot = slot_at(r, pos + i);
+		it[i] = slot->it;
+		__atomic_store_n(&slot->seq, pos + i + r->mask + 1, __ATOMIC_RELEASE);
+	}
+	return k;
+}
+
+int ring_try_push(struct ring *r, const struct item *it)
+{
+	return ring_try_push_n(r, it, 1);
+}
+
+int ring_try_pop(struct ring *r, struct item *it)
+{
+	return ring_try_pop_n(r, it, 1);
+}
+
+// full/empty look at the slot itself, the same test try_push/try_pop use
+int ring_full(struct ring *r)
+{
+	uint64_t pos = __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST);
+	uint64_t seq = __atomic_load_n(&slot_at(r, pos)->seq, __ATOMIC_SEQ_CST);
+	return (int64_t)seq - (int64_t)pos < 0;
+}
+
+int ring_empty(struct ring *r)
+{
+	uint64_t pos = __atomic_load_n(&r->head, __ATOMIC_SEQ_CST);
+	uint64_t seq = __atomic_load_n(&slot_at(r, pos)->seq, __ATOMIC_SEQ_CST);
+	return (int64_t)seq - (int64_t)(pos + 1) < 0;
+}
+
+unsigned ring_count(struct ring *r)
+{
+	uint64_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+	return (int64_t)(tail - head) > 0? tail - head : 0;
+}
+
+static long futex(uint32_t *addr, int op, uint32_t val)
+{
+	return syscall(SYS_futex, addr, op, val, NULL, NULL, 0);
+}
+
+// futexes are 32 bit, sleepers key on the half of head/tail that moves.
+// A wrap of 2^32 positions between reading it and sleeping would go
+// unnoticed, the next batch wakes the sleeper anyway
+static uint32_t *low32(uint64_t *p)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	return (uint32_t *)p + 1;
+#else
+	return (uint32_t *)p;
+#endif
+}
+
+// Full/empty as seen from one value of head/tail. The futex compares the
+// same value, so a head/tail move after the check fails the futex_wait
+// instead of being missed. The slot itself may still be on its way when
+// this says "go": that window is short, and the spin phase covers it
+static int blocked_at(struct ring *r, int producer, uint64_t v)
+{
+	if (producer)
+		return __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST) - v >= r->capacity;
+	return __atomic_load_n(&r->head, __ATOMIC_SEQ_CST) == v;
+}
+
+// Spin, yield, then sleep until the ring has room (producer) or items
+// (consumer), or is closed. Sleepers are counted so the other side only
+// makes the futex_wake syscall when someone is actually asleep; the
+// seq_cst count/fence pairs with the one in ring_wake
+static void ring_wait_once(struct ring *r, int producer)
+{
+	uint64_t *word = producer? &r->head : &r->tail;
+	int *waiters = producer? &r->full_waiters : &r->empty_waiters;
+
+	for (int i = 0; i < RING_SPINS + RING_YIELDS; i++)
+	{
+		if (!(producer? ring_full(r) : ring_empty(r)) || __atomic_load_n(&r->closed, __ATOMIC_RELAXED))
+			return;
+		if (i < RING_SPINS)
+			cpu_relax();
+		else
+			sched_yield();
+	}
+
+	uint64_t v = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+	if (blocked_at(r, producer, v) && !__atomic_load_n(&r->closed, __ATOMIC_SEQ_CST))
+		futex(low32(word), FUTEX_WAIT | r->futex_private, (uint32_t)v);
+	__atomic_sub_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+void ring_stats_add(int producer, uint64_t ns)
+{
+	if (!tstats)
+		return;
+	__atomic_fetch_add(producer? &tstats->full_waits : &tstats->empty_waits, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(producer? &tstats->full_ns : &tstats->empty_ns, ns, __ATOMIC_RELAXED);
+}
+
+// ring_wait_once, timed into the calling thread's counters
+static void ring_wait(struct ring *r, int producer)
+{
+	if (!tstats)
+	{
+		ring_wait_once(r, producer);
+		return;
+	}
+
+	uint64_t t0 = now_ns();
+	ring_wait_once(r, producer);
+	ring_stats_add(producer, now_ns() - t0);
+}
+
+void ring_stats_bind(struct ring_stats *st)
+{
+	tstats = st;
+}
+
+// called after moving `word`, wakes up to n of its sleepers
+static void ring_wake(struct ring *r, uint64_t *word, int *waiters, int n)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(waiters, __ATOMIC_RELAXED))
+		futex(low32(word), FUTEX_WAKE | r->futex_private, n);
+}
+
+// one wakeup per batch: the other side gets a single wake, and if there
+// is still room (or items) for more, the next sleeper on our own side is
+// passed along so a big batch doesn't strand everybody but one
+unsigned produce_try_n(struct ring *r, const struct item *it, unsigned n)
+{
+	unsigned k = ring_try_push_n(r, it, n);
+
+	if (k)
+	{
+		ring_wake(r, &r->tail, &r->empty_waiters, 1);
+		if (__atomic_load_n(&r->full_waiters, __ATOMIC_RELAXED) && !ring_full(r))
+			ring_wake(r, &r->head, &r->full_waiters, 1);
+	}
+	return k;
+}
+
+unsigned consume_try_n(struct ring *r, struct item *it, unsigned n)
+{
+	unsigned k = ring_try_pop_n(r, it, n);
+
+	if (k)
+	{
+		ring_wake(r, &r->head, &r->full_waiters, 1);
+		if (__atomic_load_n(&r->empty_waiters, __ATOMIC_RELAXED) && !ring_empty(r))
+			ring_wake(r, &r->tail, &r->empty_waiters, 1);
+	}
+	return k;
+}
+
+unsigned produce_n(struct ring *r, const struct item *it, unsigned n)
+{
+	unsigned done = 0;
+
+	while (done < n)
+	{
+		unsigned k = produce_try_n(r, it + done, n - done);
+		if (k)
+		{
+			done += k;
+			continue;
+		}
+		if (__atomic_load_n(&r->closed, __ATOMIC_ACQUIRE))
+			break;
+		ring_wait(r, 1);
+	}
+	return done;
+}
+
+unsigned consume_n(struct ring *r, struct item *it, unsigned n)
+{
+	for (;;)
+	{
+		unsigned k = consume_try_n(r, it, n);
+		if (k)
+			return k;
+		// producers are done, anything published before close is
+		// visible now, so one more look is enough
+		if (__atomic_load_n(&r->closed, __ATOMIC_ACQUIRE))
+			return ring_try_pop_n(r, it, n);
+		ring_wait(r, 0);
+	}
+}
+
+// closing doesn't move head/tail, so a sleeper that checked `closed`
+// just before it was set can still be on its way into futex_wait:
+// keep waking until everybody has left, or for RING_CLOSE_TRIES rounds
+// when some of them may be in a process that's gone
+void ring_close(struct ring *r)
+{
+	__atomic_store_n(&r->closed, 1, __ATOMIC_SEQ_CST);
+	for (int i = 0; r->futex_private || i < RING_CLOSE_TRIES; i++)
+	{
+		if (!__atomic_load_n(&r->full_waiters, __ATOMIC_SEQ_CST) && !__atomic_load_n(&r->empty_waiters, __ATOMIC_SEQ_CST))
+			break;
+		futex(low32(&r->head), FUTEX_WAKE | r->futex_private, INT_MAX);
+		futex(low32(&r->tail), FUTEX_WAKE | r->futex_private, INT_MAX);
+		sched_yield();
+	}
+}
+
+static struct ring_shm *shm_of(struct ring *r)
+{
+	return (struct ring_shm *)((char *)r - offsetof(struct ring_shm, r));
+}
+
+// wait for the creator: first ftruncate() gives the object its size,
+// then `magic` says the ring is set up
+static struct ring *ring_shm_attach(int fd)
+{
+	struct stat st;
+	struct ring_shm *shm;
+	int i;
+
+	for (i = 0; i < RING_SHM_TRIES; i++)
+	{
+		if (fstat(fd, &st))
+			return NULL;
+		if (st.st_size >= (off_t)sizeof(struct ring_shm))
+			break;
+		usleep(1000);
+	}
+	if (i == RING_SHM_TRIES)
+	{
+		errno = EAGAIN;
+		return NULL;
+	}
+
+	shm = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shm == MAP_FAILED)
+		return NULL;
+
+	for (i = 0; i < RING_SHM_TRIES; i++)
+	{
+		if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) == RING_SHM_MAGIC)
+			break;
+		usleep(1000);
+	}
+	if (i == RING_SHM_TRIES || shm->size != (uint64_t)st.st_size)
+	{
+		munmap(shm, st.st_size);
+		errno = EINVAL;
+		return NULL;
+	}
+	return &shm->r;
+}
+
+struct ring *ring_shm_open(const char *name, unsigned capacity)
+{
+	struct ring_shm *shm;
+	struct ring *r;
+	unsigned n = 1;
+	int fd;
+
+	if (capacity > RING_MAX_CAPACITY)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	while (n < capacity)
+		n <<= 1;
+	size_t size = sizeof(struct ring_shm) + sizeof(struct ring_slot) * n;
+
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0)
+	{
+		if (errno != EEXIST || (fd = shm_open(name, O_RDWR, 0)) < 0)
+			return NULL;
+		r = ring_shm_attach(fd);
+		close(fd);
+		return r;
+	}
+
+	if (ftruncate(fd, size))
+		goto fail;
+	shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shm == MAP_FAILED)
+		goto fail;
+	close(fd);
+
+	// other processes wait on the same futexes, so no FUTEX_PRIVATE_FLAG
+	ring_setup(&shm->r, (struct ring_slot *)(shm + 1), n, 0);
+	shm->producers = 0;
+	shm->size = size;
+	__atomic_store_n(&shm->magic, RING_SHM_MAGIC, __ATOMIC_RELEASE);
+	return &shm->r;
+
+fail:
+	close(fd);
+	shm_unlink(name);
+	return NULL;
+}
+
+void ring_shm_close(struct ring *r)
+{
+	struct ring_shm *shm = shm_of(r);
+	munmap(shm, shm->size);
+}
+
+int ring_shm_unlink(const char *name)
+{
+	return shm_unlink(name);
+}
+
+void ring_shm_add_producer(struct ring *r)
+{
+	__atomic_add_fetch(&shm_of(r)->producers, 1, __ATOMIC_SEQ_CST);
+}
+
+void ring_shm_del_producer(struct ring *r)
+{
+	if (__atomic_sub_fetch(&shm_of(r)->producers, 1, __ATOMIC_SEQ_CST) == 0)
+		ring_close(r);
+}
+
+// Byte ring. Every message starts with a header; `len` is the payload,
+// except for PAD, which fills the end of the buffer when a message
+// doesn't fit there, and whose `len` is its whole size. A header is
+// written before `tail` moves past it, and only positions between head
+// and tail are ever read, so nobody sees a header from an older lap
+struct bring_hdr
+{
+	uint32_t len;
+	uint32_t state;
+};
+
+#define BRING_BUSY 1	// reserved, being written
+#define BRING_READY 2	// committed, waiting for a consumer
+#define BRING_DONE 3	// released, space can go back to producers
+#define BRING_PAD 4	// no message, skip to the start of the buffer
+
+// header plus payload, rounded up so the next header stays aligned
+#define BRING_REC(len) (((uint64_t)(len) + sizeof(struct bring_hdr) + 7) & ~(uint64_t)7)
+
+static struct bring_hdr *hdr_at(struct bring *b, uint64_t pos)
+{
+	return (struct bring_hdr *)(b->buf + (pos & b->mask));
+}
+
+static uint64_t rec_size(struct bring_hdr *h, uint32_t state)
+{
+	return (state == BRING_PAD)? h->len : BRING_REC(h->len);
+}
+
+int bring_init(struct bring *b, size_t size)
+{
+	size_t n = CACHE_LINE;
+
+	if (size > SIZE_MAX / 2 + 1)
+		return -1;
+	while (n < size)
+		n <<= 1;
+
+	if (posix_memalign((void **)&b->buf, CACHE_LINE, n))
+		return -1;
+
+	b->size = n;
+	b->mask = n - 1;
+	b->tail = 0;
+	b->read = 0;
+	b->head = 0;
+	b->lock = 0;
+	b->full_waiters = 0;
+	b->empty_waiters = 0;
+	b->frees = 0;
+	b->commits = 0;
+	b->closed = 0;
+	return 0;
+}
+
+void bring_destroy(struct bring *b)
+{
+	free(b->buf);
+	b->buf = NULL;
+}
+
+// a message of the largest size plus the biggest pad in front of it
+// still fit in an empty ring
+uint32_t bring_max(struct bring *b)
+{
+	return b->size / 2 - sizeof(struct bring_hdr);
+}
+
+// bytes a `rec` byte message takes at the current tail, pad included
+static uint64_t bring_need(struct bring *b, uint64_t tail, uint64_t rec)
+{
+	uint64_t off = tail & b->mask;
+	return (off + rec > b->size)? b->size - off + rec : rec;
+}
+
+static int bring_blocked(struct bring *b, int producer, uint64_t rec)
+{
+	if (producer)
+	{
+		uint64_t tail = __atomic_load_n(&b->tail, __ATOMIC_SEQ_CST);
+		uint64_t head = __atomic_load_n(&b->head, __ATOMIC_SEQ_CST);
+		return tail + bring_need(b, tail, rec) - head > b->size;
+	}
+
+	uint64_t read = __atomic_load_n(&b->read, __ATOMIC_SEQ_CST);
+	if (read == __atomic_load_n(&b->tail, __ATOMIC_SEQ_CST))
+		return 1;
+	return __atomic_load_n(&hdr_at(b, read)->state, __ATOMIC_SEQ_CST) == BRING_BUSY;
+}
+
+// Same spin, yield, sleep as ring_wait. Head/tail don't tell a consumer
+// about commits, so each side sleeps on a counter the other side bumps
+// (only when somebody waits) instead, and the counter read before the
+// last check catches a bump that comes in between
+static void bring_wait(struct bring *b, int producer, uint64_t rec)
+{
+	uint32_t *word = producer? &b->frees : &b->commits;
+	int *waiters = producer? &b->full_waiters : &b->empty_waiters;
+	uint64_t t0 = tstats? now_ns() : 0;
+
+	for (int i = 0; i < RING_SPINS + RING_YIELDS; i++)
+	{
+		if (!bring_blocked(b, producer, rec) || __atomic_load_n(&b->closed, __ATOMIC_RELAXED))
+			goto out;
+		if (i < RING_SPINS)
+			cpu_relax();
+		else
+			sched_yield();
+	}
+
+	uint32_t v = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+	__atomic_add_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+	if (bring_blocked(b, producer, rec) && !__atomic_load_n(&b->closed, __ATOMIC_SEQ_CST))
+		futex(word, FUTEX_WAIT_PRIVATE, v);
+	__atomic_sub_fetch(waiters, 1, __ATOMIC_SEQ_CST);
+
+out:
+	if (tstats)
+	{
+		uint64_t ns = now_ns() - t0;
+		__atomic_fetch_add(producer? &tstats->full_waits : &tstats->empty_waits, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(producer? &tstats->full_ns : &tstats->empty_ns, ns, __ATOMIC_RELAXED);
+	}
+}
+
+static void bring_wake(uint32_t *word, int *waiters, int n)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(waiters, __ATOMIC_RELAXED))
+	{
+		__atomic_add_fetch(word, 1, __ATOMIC_SEQ_CST);
+		futex(word, FUTEX_WAKE_PRIVATE, n);
+	}
+}
+
+static void bring_lock(struct bring *b)
+{
+	while (__atomic_exchange_n(&b->lock, 1, __ATOMIC_ACQUIRE))
+		while (__atomic_load_n(&b->lock, __ATOMIC_RELAXED))
+			sched_yield();
+}
+
+static void bring_unlock(struct bring *b)
+{
+	__atomic_store_n(&b->lock, 0, __ATOMIC_RELEASE);
+}
+
+void *bring_reserve(struct bring *b, uint32_t len)
+{
+	uint64_t rec = BRING_REC(len);
+	uint64_t tail, need;
+
+	if (len > bring_max(b))
+	{
+		errno = EMSGSIZE;
+		return NULL;
+	}
+
+	for (;;)
+	{
+		if (__atomic_load_n(&b->closed, __ATOMIC_ACQUIRE))
+			return NULL;
+
+		bring_lock(b);
+		tail = b->tail;
+		need = bring_need(b, tail, rec);
+		// acquire: consumers are done reading what head has passed
+		if (tail + need - __atomic_load_n(&b->head, __ATOMIC_ACQUIRE) <= b->size)
+			break;
+		bring_unlock(b);
+		bring_wait(b, 1, rec);
+	}
+
+	if (need > rec)
+	{
+		struct bring_hdr *pad = hdr_at(b, tail);
+		pad->len = need - rec;
+		pad->state = BRING_PAD;
+		tail += need - rec;
+	}
+
+	struct bring_hdr *h = hdr_at(b, tail);
+	h->len = len;
+	h->state = BRING_BUSY;
+	__atomic_store_n(&b->tail, tail + rec, __ATOMIC_RELEASE);
+	bring_unlock(b);
+	return h + 1;
+}
+
+void bring_commit(struct bring *b, void *msg)
+{
+	struct bring_hdr *h = (struct bring_hdr *)msg - 1;
+
+	__atomic_store_n(&h->state, BRING_READY, __ATOMIC_SEQ_CST);
+	bring_wake(&b->commits, &b->empty_waiters, 1);
+}
+
+// Move head over released messages (and pads) at the front. Whoever
+// releases tries, so the space comes back even if the oldest message is
+// released last. A stale head only costs a failed CAS
+static void bring_advance(struct bring *b)
+{
+	int moved = 0;
+
+	for (;;)
+	{
+		uint64_t head = __atomic_load_n(&b->head, __ATOMIC_SEQ_CST);
+		if (head == __atomic_load_n(&b->read, __ATOMIC_SEQ_CST))
+			break;
+
+		struct bring_hdr *h = hdr_at(b, head);
+		uint32_t state = __atomic_load_n(&h->state, __ATOMIC_SEQ_CST);
+		if (state != BRING_DONE && state != BRING_PAD)
+			break;
+		if (__atomic_compare_exchange_n(&b->head, &head, head + rec_size(h, state), 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			moved = 1;
+	}
+
+	if (moved)
+		bring_wake(&b->frees, &b->full_waiters, INT_MAX);
+}
+
+void *bring_view(struct bring *b, uint32_t *len)
+{
+	for (;;)
+	{
+		uint64_t read = __atomic_load_n(&b->read, __ATOMIC_ACQUIRE);
+		uint64_t tail = __atomic_load_n(&b->tail, __ATOMIC_ACQUIRE);
+
+		if (read == tail)
+		{
+			if (__atomic_load_n(&b->closed, __ATOMIC_ACQUIRE))
+				return NULL;
+		}
+		else
+		{
+			struct bring_hdr *h = hdr_at(b, read);
+			uint32_t state = __atomic_load_n(&h->state, __ATOMIC_ACQUIRE);
+
+			if (state == BRING_READY || state == BRING_PAD)
+			{
+				uint64_t rec = rec_size(h, state);
+				if (!__atomic_compare_exchange_n(&b->read, &read, read + rec, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+					continue;
+				if (state == BRING_PAD)
+				{
+					bring_advance(b);
+					continue;
+				}
+				// a commit further on may have woken just us, pass it along
+				if (__atomic_load_n(&b->empty_waiters, __ATOMIC_RELAXED) && read + rec != __atomic_load_n(&b->tail, __ATOMIC_RELAXED))
+					bring_wake(&b->commits, &b->empty_waiters, 1);
+				*len = h->len;
+				return h + 1;
+			}
+		}
+		bring_wait(b, 0, 0);
+	}
+}
+
+void bring_release(struct bring *b, void *msg)
+{
+	struct bring_hdr *h = (struct bring_hdr *)msg - 1;
+
+	__atomic_store_n(&h->state, BRING_DONE, __ATOMIC_SEQ_CST);
+	bring_advance(b);
+}
+
+uint64_t bring_used(struct bring *b)
+{
+	return __atomic_load_n(&b->tail, __ATOMIC_RELAXED) - __atomic_load_n(&b->head, __ATOMIC_RELAXED);
+}
+
+// same as ring_close for a private ring: the bumps fail the futex_wait
+// of a sleeper on its way in, keep at it until everybody has left
+void bring_close(struct bring *b)
+{
+	__atomic_store_n(&b->closed, 1, __ATOMIC_SEQ_CST);
+	for (;;)
+	{
+		if (!__atomic_load_n(&b->full_waiters, __ATOMIC_SEQ_CST) && !__atomic_load_n(&b->empty_waiters, __ATOMIC_SEQ_CST))
+			break;
+		__atomic_add_fetch(&b->frees, 1, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&b->commits, 1, __ATOMIC_SEQ_CST);
+		futex(&b->frees, FUTEX_WAKE_PRIVATE, INT_MAX);
+		futex(&b->commits, FUTEX_WAKE_PRIVATE, INT_MAX);
+		sched_yield();
+	}
+}
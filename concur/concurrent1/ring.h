@@ -0,0 +1,171 @@
+/*
+cs544 Concurrency 1 - bounded lock-free ring buffers for items and bytes
+
+Multi-producer/multi-consumer ring (D. Vyukov's bounded queue): every slot
+has a sequence number telling whose turn it is, so producers and consumers
+only fight over head/tail with one CAS and never scan the buffer.
+
+Batches claim a run of slots with that same single CAS. Blocking is only
+for a full or empty ring: a waiter spins a little, then yields, then
+sleeps on a futex on the low 32 bits of head (producers) or tail
+(consumers). The other side makes the futex_wake syscall once per batch,
+and only when somebody is asleep.
+*/
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+
+#define CACHE_LINE 64
+
+// item struct
+struct item
+{
+	int a;
+	int b;
+	uint64_t t;	// enqueue time, ns
+};
+
+// seq == position: free for the producer of that position
+// seq == position+1: holds an item for the consumer of that position
+struct ring_slot
+{
+	uint64_t seq;
+	struct item it;
+};
+
+// head and tail live on their own cache lines, so producers and
+// consumers don't bounce each other's line on every operation. Each
+// waiter count sits next to the word its sleepers wait on, the thread
+// that moves that word is the one that checks it
+struct ring
+{
+	uint64_t head __attribute__((aligned(CACHE_LINE)));	// next position to consume
+	int full_waiters;	// producers asleep until head moves
+
+	uint64_t tail __attribute__((aligned(CACHE_LINE)));	// next position to produce
+	int empty_waiters;	// consumers asleep until tail moves
+
+	intptr_t slots_off __attribute__((aligned(CACHE_LINE)));	// slots, relative to the ring itself
+	uint64_t mask;
+	unsigned capacity;	// slots allocated, power of two
+	int closed;	// no more items will come, wake everybody up
+	int futex_private;	// FUTEX_PRIVATE_FLAG, or 0 when shared between processes
+};
+
+// largest power of two an unsigned capacity can be rounded up to
+#define RING_MAX_CAPACITY (1u << 31)
+
+// capacity is rounded up to power of two, returns -1 if out of memory or
+// over RING_MAX_CAPACITY
+int ring_init(struct ring *r, unsigned capacity);
+void ring_destroy(struct ring *r);
+
+// non-blocking, return number of items moved, 0 if ring is full/empty.
+// A batch takes as many contiguous slots as are ready, up to n
+unsigned ring_try_push_n(struct ring *r, const struct item *it, unsigned n);
+unsigned ring_try_pop_n(struct ring *r, struct item *it, unsigned n);
+
+// single item versions, return 1 on success, 0 if ring is full/empty
+int ring_try_push(struct ring *r, const struct item *it);
+int ring_try_pop(struct ring *r, struct item *it);
+
+// blocking: produce_n puts all n items (less only if ring gets closed),
+// consume_n waits for at least one item and takes up to n.
+// consume_n returns 0 only when the ring is closed and drained
+unsigned produce_n(struct ring *r, const struct item *it, unsigned n);
+unsigned consume_n(struct ring *r, struct item *it, unsigned n);
+
+// non-blocking produce_n/consume_n: move what fits right now, and wake
+// the other side like the blocking versions do
+unsigned produce_try_n(struct ring *r, const struct item *it, unsigned n);
+unsigned consume_try_n(struct ring *r, struct item *it, unsigned n);
+
+// Time each thread spends waiting on a full or empty ring (spinning,
+// yielding and asleep). A thread that wants it binds its own counters
+// once; they are only ever added to, so another thread can read them
+// while it runs
+struct ring_stats
+{
+	uint64_t full_waits;
+	uint64_t full_ns;
+	uint64_t empty_waits;
+	uint64_t empty_ns;
+};
+
+void ring_stats_bind(struct ring_stats *st);
+// a wait of `ns` done outside the ring (idle consumers of shard.h), into
+// the calling thread's counters if it has any
+void ring_stats_add(int producer, uint64_t ns);
+
+// racy hints, good for messages and statistics only
+int ring_full(struct ring *r);
+int ring_empty(struct ring *r);
+// items claimed by producers and not yet by consumers
+unsigned ring_count(struct ring *r);
+
+// wake all blocked threads, producers stop, consumers drain what's left
+void ring_close(struct ring *r);
+
+// Ring in a named POSIX shared memory object, for producers and consumers
+// in different processes. Items go straight into the mapping and back out,
+// the kernel only gets involved to sleep and wake. ring_shm_open creates
+// the ring with `capacity` slots, or attaches to it if it already exists.
+// NULL on error, with errno set (EINVAL over RING_MAX_CAPACITY)
+struct ring *ring_shm_open(const char *name, unsigned capacity);
+void ring_shm_close(struct ring *r);	// unmap, the ring stays
+int ring_shm_unlink(const char *name);	// remove the name, mappings stay
+
+// producers count themselves in and out, the last one out closes the ring
+void ring_shm_add_producer(struct ring *r);
+void ring_shm_del_producer(struct ring *r);
+
+// Byte ring: variable-size messages written and read in place. A
+// producer reserves `len` bytes, fills them where they lie and commits;
+// a consumer gets a view of the oldest message, uses it where it lies
+// and releases it. Nothing is copied or malloc'ed per message. Space
+// comes back in ring order, when the oldest messages are released.
+// Producers take a short spinlock to reserve, consumers claim messages
+// with a CAS, waiting works like the item ring's
+struct bring
+{
+	uint64_t tail __attribute__((aligned(CACHE_LINE)));	// next byte to reserve
+	int lock;	// producers reserve one at a time
+	int full_waiters;	// producers asleep until space comes back
+	uint32_t frees;	// bumped when it does and somebody waits
+
+	uint64_t read __attribute__((aligned(CACHE_LINE)));	// next message to view
+	int empty_waiters;	// consumers asleep until a commit
+	uint32_t commits;	// bumped on commit when somebody waits
+
+	uint64_t head __attribute__((aligned(CACHE_LINE)));	// all bytes before are released
+
+	unsigned char *buf __attribute__((aligned(CACHE_LINE)));
+	uint64_t size;	// bytes, power of two
+	uint64_t mask;
+	int closed;
+};
+
+// `size` is rounded up to power of two, returns -1 if out of memory or
+// there's no power of two that big
+int bring_init(struct bring *b, size_t size);
+void bring_destroy(struct bring *b);
+// largest message that fits, about half the ring
+uint32_t bring_max(struct bring *b);
+
+// blocks until there is room, NULL if the ring is closed or `len` is
+// more than bring_max(). The space is 8 byte aligned
+void *bring_reserve(struct bring *b, uint32_t len);
+void bring_commit(struct bring *b, void *msg);
+
+// blocks until the next message is committed, NULL once the ring is
+// closed and drained. Messages come out in reserve order
+void *bring_view(struct bring *b, uint32_t *len);
+void bring_release(struct bring *b, void *msg);
+
+// bytes reserved and not yet released, racy hint
+uint64_t bring_used(struct bring *b);
+// wake everybody up, reserve fails from now on, view drains what's left
+void bring_close(struct bring *b);
+
+#endif
@@ -0,0 +1,172 @@
+/*
+cs544 Concurrency 1 - sharded item queues with work stealing
+*/
+#define _GNU_SOURCE
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "shard.h"
+#include "rt.h"
+
+// an idle consumer goes round the shards this many times, yielding in
+// between, before it sleeps
+#define SHARD_YIELDS 8
+
+static long futex(uint32_t *addr, int op, uint32_t val)
+{
+	return syscall(SYS_futex, addr, op, val, NULL, NULL, 0);
+}
+
+int shards_init(struct shards *s, int n, unsigned capacity)
+{
+	// rings are cache line aligned inside, the array has to be too
+	if (posix_memalign((void **)&s->r, CACHE_LINE, sizeof(struct ring) * n))
+		return -1;
+
+	for (int i = 0; i < n; i++)
+		if (ring_init(&s->r[i], capacity))
+		{
+			while (i--)
+				ring_destroy(&s->r[i]);
+			free(s->r);
+			return -1;
+		}
+	s->n = n;
+	s->idle = 0;
+	s->idle_waiters = 0;
+	return 0;
+}
+
+void shards_destroy(struct shards *s)
+{
+	for (int i = 0; i < s->n; i++)
+		ring_destroy(&s->r[i]);
+	free(s->r);
+	s->r = NULL;
+}
+
+int shards_home(struct shards *s, int id, int no_p)
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (cores < 1)
+		cores = 1;
+
+	// consumer c sits on core (no_p+c) % cores, producer id on id % cores
+	int c = ((id - no_p) % cores + cores) % cores;
+	if (c < s->n)
+		return c;
+	return id % s->n;
+}
+
+// home first; when it is full, whatever fits in the other shards right
+// now; only then wait for room at home
+unsigned shards_push(struct shards *s, int home, const struct item *it, unsigned n)
+{
+	unsigned done = produce_try_n(&s->r[home], it, n);
+
+	for (int v = 1; v < s->n && done < n; v++)
+		done += produce_try_n(&s->r[(home + v) % s->n], it + done, n - done);
+
+	if (done < n)
+		done += produce_n(&s->r[home], it + done, n - done);
+
+	// the seq_cst fence pairs with the waiter count in shards_pop: either
+	// we see the sleeper, or it sees what we just pushed
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (s->n > 1 && done && __atomic_load_n(&s->idle_waiters, __ATOMIC_RELAXED))
+	{
+		__atomic_add_fetch(&s->idle, 1, __ATOMIC_SEQ_CST);
+		futex(&s->idle, FUTEX_WAKE_PRIVATE, done);
+	}
+	return done;
+}
+
+// home first, then up to half of what a victim holds
+static unsigned grab(struct shards *s, int home, struct item *it, unsigned n)
+{
+	unsigned k = consume_try_n(&s->r[home], it, n);
+	if (k)
+		return k;
+
+	for (int v = 1; v < s->n; v++)
+	{
+		struct ring *victim = &s->r[(home + v) % s->n];
+		unsigned half = (ring_count(victim) + 1) / 2;
+
+		if (half == 0)
+			continue;
+		k = consume_try_n(victim, it, half < n? half : n);
+		if (k)
+			return k;
+	}
+	return 0;
+}
+
+// closed, and nothing left anywhere to steal
+static int drained(struct shards *s)
+{
+	for (int i = 0; i < s->n; i++)
+		if (!__atomic_load_n(&s->r[i].closed, __ATOMIC_SEQ_CST) || ring_count(&s->r[i]))
+			return 0;
+	return 1;
+}
+
+// Stealing: a thief takes up to half of what the victim holds with one
+// CAS on the victim's head, so the owner keeps the rest and the two
+// don't end up trading the same items back and forth. The owner takes
+// from the same end (rings are FIFO, unlike a Chase-Lev deque), which
+// keeps latency fair. A shard may have no producer of its own, so a
+// consumer with nothing to steal sleeps on the shared idle word and goes
+// round all the shards again every time it is bumped
+unsigned shards_pop(struct shards *s, int home, struct item *it, unsigned n)
+{
+	uint64_t idle_ns = 0;
+	unsigned k;
+
+	if (s->n == 1)
+		return consume_n(&s->r[0], it, n);
+
+	for (int i = 0;; i++)
+	{
+		if ((k = grab(s, home, it, n)) || drained(s))
+			break;
+
+		// only rounds that found nothing count as blocked on empty
+		uint64_t t0 = now_ns();
+		if (i < SHARD_YIELDS)
+			sched_yield();
+		else
+		{
+			// a bump after `seen` fails the futex_wait instead of being missed
+			uint32_t seen = __atomic_load_n(&s->idle, __ATOMIC_SEQ_CST);
+			__atomic_add_fetch(&s->idle_waiters, 1, __ATOMIC_SEQ_CST);
+			if (!(k = grab(s, home, it, n)) && !drained(s))
+				futex(&s->idle, FUTEX_WAIT_PRIVATE, seen);
+			__atomic_sub_fetch(&s->idle_waiters, 1, __ATOMIC_SEQ_CST);
+		}
+		idle_ns += now_ns() - t0;
+		if (k)
+			break;
+	}
+
+	if (idle_ns)
+		ring_stats_add(0, idle_ns);
+	return k;
+}
+
+void shards_close(struct shards *s)
+{
+	for (int i = 0; i < s->n; i++)
+		ring_close(&s->r[i]);
+
+	// one bump is enough: a sleeper that read idle before it either wakes
+	// up here or fails its futex_wait, one that read it after sees closed
+	__atomic_add_fetch(&s->idle, 1, __ATOMIC_SEQ_CST);
+	futex(&s->idle, FUTEX_WAKE_PRIVATE, INT_MAX);
+}
@@ -0,0 +1,43 @@
+/*
+cs544 Concurrency 1 - sharded item queues with work stealing
+
+One ring per consumer instead of one ring for everybody. A producer
+feeds the shard of the consumer on its own core (or a hashed one when
+there is none), a consumer eats from its own shard and steals from the
+others when that runs dry. With a single shard this is just the ring.
+
+A producer only ever wakes the consumer of the shard it fed, so idle
+consumers don't sleep on their own shard: they share one futex word,
+bumped by any producer that sees one of them asleep and by close.
+*/
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "ring.h"
+
+struct shards
+{
+	int n;
+	struct ring *r;
+
+	uint32_t idle __attribute__((aligned(CACHE_LINE)));	// bumped when there may be something to steal
+	int idle_waiters;	// consumers asleep on idle
+};
+
+// `n` rings of `capacity` slots each, returns -1 if out of memory
+int shards_init(struct shards *s, int n, unsigned capacity);
+void shards_destroy(struct shards *s);
+
+// home shard of producer `id` when producers and consumers are pinned
+// by start_pool(): producers on cores 0.., consumers right after them
+int shards_home(struct shards *s, int id, int no_p);
+
+// like produce_n/consume_n on the home shard, but a full home spills
+// into other shards and an empty home steals from them first. Pop
+// returns 0 only when every shard is closed and drained
+unsigned shards_push(struct shards *s, int home, const struct item *it, unsigned n);
+unsigned shards_pop(struct shards *s, int home, struct item *it, unsigned n);
+
+void shards_close(struct shards *s);
+
+#endif
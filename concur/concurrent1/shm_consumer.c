@@ -0,0 +1,97 @@
+/*
+cs544 Concurrency 1 - consumer process for the shared memory ring
+
+Attaches to (or creates) the ring called NAME and takes items until the
+producers are gone and the ring is empty, then removes the name and
+prints throughput and enqueue-to-dequeue latency.
+*/
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "ring.h"
+#include "rt.h"
+
+#define CAPACITY 1024
+#define WORK_NS 1000
+
+void usage(char *name)
+{
+	printf("usage: %s [-q CAPACITY] [-n BATCH] [-w WORK_NS] NAME\n", name);
+	printf("  NAME is a shared memory name like /cnp, CAPACITY only counts if this creates the ring\n");
+}
+
+int main(int argc, char** argv)
+{
+	int capacity = CAPACITY;
+	int batch = 1;
+	uint64_t work_ns = WORK_NS;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "q:n:w:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'q': capacity = atoi(optarg); break;
+			case 'n': batch = atoi(optarg); break;
+			case 'w': work_ns = atoll(optarg); break;
+			default:
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+	if (argc - optind != 1 || capacity <= 0 || batch <= 0) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	char *name = argv[optind];
+
+	struct ring *r = ring_shm_open(name, capacity);
+	if (!r) {
+		fprintf(stderr, "can't open ring %s: %s\n", name, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	calibrate();
+
+	struct item *its = malloc(sizeof(struct item)*batch);
+	struct hist *lat = calloc(1, sizeof(struct hist));
+	uint64_t t0 = 0;
+	long done = 0;
+	unsigned n;
+
+	while ((n = consume_n(r, its, batch)) > 0)
+	{
+		uint64_t t = now_ns();
+
+		// time from the first item, not from however long we waited for a producer
+		if (!t0)
+			t0 = t;
+		for (unsigned i=0; i<n; i++)
+		{
+			hist_add(lat, t - its[i].t);
+			busy_work(work_ns);
+		}
+		done += n;
+	}
+
+	// the first consumer out takes the name away, a new producer makes a new ring
+	if (ring_shm_unlink(name) && errno != ENOENT)
+		fprintf(stderr, "can't remove ring %s: %s\n", name, strerror(errno));
+
+	double secs = t0? (now_ns() - t0)/1e9 : 0;
+	printf("consumer %d: %ld items in %.3f s, %.1f items/s, latency p50 %llu ns p99 %llu ns max %llu ns\n",
+		getpid(), done, secs, secs? done/secs : 0,
+		(unsigned long long)hist_percentile(lat, 50), (unsigned long long)hist_percentile(lat, 99),
+		(unsigned long long)lat->max);
+
+	free(its);
+	free(lat);
+	ring_shm_close(r);
+	return 0;
+}
@@ -0,0 +1,99 @@
+/*
+cs544 Concurrency 1 - producer process for the shared memory ring
+
+Attaches to (or creates) the ring called NAME, puts ITEMS items in it
+and leaves. The ring closes when the last attached producer leaves, so
+start all producers before the first one is done.
+*/
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "ring.h"
+#include "rt.h"
+
+#define CAPACITY 1024
+#define WORK_NS 1000
+
+void usage(char *name)
+{
+	printf("usage: %s [-q CAPACITY] [-n BATCH] [-w WORK_NS] NAME ITEMS\n", name);
+	printf("  NAME is a shared memory name like /cnp, CAPACITY only counts if this creates the ring\n");
+}
+
+int main(int argc, char** argv)
+{
+	int capacity = CAPACITY;
+	int batch = 1;
+	uint64_t work_ns = WORK_NS;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "q:n:w:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'q': capacity = atoi(optarg); break;
+			case 'n': batch = atoi(optarg); break;
+			case 'w': work_ns = atoll(optarg); break;
+			default:
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+	if (argc - optind != 2 || capacity <= 0 || batch <= 0) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	char *name = argv[optind];
+	long items = atol(argv[optind+1]);
+
+	struct ring *r = ring_shm_open(name, capacity);
+	if (!r) {
+		fprintf(stderr, "can't open ring %s: %s\n", name, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	ring_shm_add_producer(r);
+
+	rt_srand(time(NULL) ^ getpid());
+	calibrate();
+
+	struct item *its = malloc(sizeof(struct item)*batch);
+	uint64_t t0 = now_ns();
+	long done = 0;
+
+	while (done < items)
+	{
+		int n = (items-done < batch)? items-done : batch;
+
+		for (int i=0; i<n; i++)
+		{
+			busy_work(work_ns);
+			its[i].a = rt_rand()%10;
+			its[i].b = 2+rt_rand()%8;
+			// CLOCK_MONOTONIC is the same in every process, the consumer
+			// can take its latency from this
+			its[i].t = now_ns();
+		}
+
+		unsigned k = produce_n(r, its, n);
+		done += k;
+		if (k < (unsigned)n) {
+			fprintf(stderr, "ring %s got closed\n", name);
+			break;
+		}
+	}
+
+	double secs = (now_ns() - t0)/1e9;
+	printf("producer %d: %ld items in %.3f s, %.1f items/s\n", getpid(), done, secs, done/secs);
+
+	free(its);
+	ring_shm_del_producer(r);
+	ring_shm_close(r);
+	return 0;
+}
@@ -6,183 +6,325 @@ Group 26 Li Li, Hafed Alghamdi
 Oct 18 2014
 
 */
+#define _GNU_SOURCE
+
 #include <pthread.h>
-#include <semaphore.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
 #include <stdbool.h>
 
-// 2+5 semaphores, two of them are for left and right forks. 
-// The other 5 just indicate if the philosopher has eaten sth.
+#include "coro.h"
+#include "dine.h"
+#include "rt.h"
+#include "trace.h"
+
+#define PHILOSOPHERS 5
+#define SECONDS 2
+#define THINK_US 1000
+#define EAT_US 1000
+#define INTERVAL_MS 1000
+
+// the status table shows this many philosophers at most
+#define SHOWN 5
+
+char *phi_name[SHOWN] = { "Dijkstra", "Confucius", "Li", "Hafed", "KingFaysal" };
 
-sem_t sem_left;
-sem_t sem_right;
+struct dine table;
+struct dine_stats stats;
+volatile bool dining;
+// per philosopher rows go here, if anywhere
+FILE *phil_out;
+// snapshots every interval_ms, compact, if anywhere
+FILE *log_out;
+unsigned interval_ms = INTERVAL_MS;
+// binary trace of the run goes here, if anywhere; FILE.strategy when
+// there's more than one
+char *trace_file;
+bool trace_each;
 
-sem_t sem_phi[5];
+// one snapshot of the table
+void print_table(struct dine_view *v, int shown)
+{
+	fprintf(stdout,"Name:\t ");
+	for(int i=0;i<shown;i++)
+		fprintf(stdout, "%10s\t",phi_name[i]);
+	fprintf(stdout,"\n");
+
+	fprintf(stdout,"Forks got: ");
+	for(int i=0;i<shown;i++)
+		fprintf(stdout, "%10d\t",v[i].held);
+	fprintf(stdout,"\n");
 
-bool phi[5];
-char *phi_name[5];
+	fprintf(stdout,"Name:\t ");
+	for(int i=0;i<shown;i++)
+		switch(v[i].state){
+			case DINE_HUNGRY:
+			fprintf(stdout, " Blocking \t");
+			break;
 
-int phi_forks[5];
+			case DINE_THINKING:
+			fprintf(stdout, " Thinking \t");
+			break;
 
-// philosopher status: 0,1,2.
-// 0 means blocking, 1 means thinking, 2 means eating
-int phi_status[5];
+			case DINE_EATING:
+			fprintf(stdout, "  Eating  \t");
+			break;
 
+			default:
+			fprintf(stdout, "switch has sth wrong\n");
+		}
+	fprintf(stdout,"\n");
 
+	fprintf(stdout,"Meals: \t ");
+	for(int i=0;i<shown;i++)
+		fprintf(stdout, "%10ld\t",v[i].meals);
+	fprintf(stdout,"\n");
 
+	fprintf(stdout, "----------------------------------------------\n");
+}
 
-// philosopher function try to do following steps:
-// 1. thinking, when thinking we assign them a thinking status.
-// 2. try to entre the geting fork step, we have separate semaphores for each 
-// philosophers. They can only eat once in a cycle. 
-// 3. get fork, left first and then right
-// 4. eating and putfork, release the fork. left first and then right.
-void * philosopher(void* arg)
+// compact snapshot: one CSV line, a letter and a digit per philosopher
+void print_line(struct dine_view *v, int n, uint64_t ms)
 {
-	int phi_no = *((int*)arg);
-	for(;;)
+	static const char letter[] = { 'T', 'H', 'E' };
+	long meals = 0;
+
+	fprintf(log_out, "%s,%llu,", dine_strategy_name(table.cfg.strategy), (unsigned long long)ms);
+	for(int i=0;i<n;i++)
+		fputc(letter[v[i].state], log_out);
+	fputc(',', log_out);
+	for(int i=0;i<n;i++)
 	{
+		fputc('0' + v[i].held, log_out);
+		meals += v[i].meals;
+	}
+	fprintf(log_out, ",%ld\n", meals);
+}
 
-		//think();
-		int rd_think = 1+rand()%20;
-		phi_status[phi_no] = 1;
-		sleep(rd_think);
-		phi_status[phi_no] = 0;
-		
-		sem_wait(&sem_phi[phi_no]);
-		
-		//get_fork();
-		
-		sem_wait(&sem_left);
-		phi_forks[phi_no] += 1;
-		
-		sem_wait(&sem_right);
-		phi_forks[phi_no] += 1;
-		
-		phi[phi_no] = 1;
-		if(phi[0]&&phi[1]&&phi[2]&&phi[3]&&phi[4] )
-			{
-				for(int i=0;i<5;i++)
-					{
-					sem_post(&sem_phi[i]);
-					phi[i] = 0;
-					}
-			}
-			
-		//eat();
-		int rd_eat = 2+rand()%8;
-		phi_status[phi_no] = 2;
-		sleep(rd_eat);
-		phi_status[phi_no] = 0;	
-		
-
-		//put_fork();
-		
-		sem_post(&sem_left);
-		phi_forks[phi_no] -= 1;
-		
-		sem_post(&sem_right);
-		phi_forks[phi_no] -= 1;
-		
-
-	 }
-	
+// separate thread printer takes a snapshot every interval to check if
+// program meets the requirements. Philosophers publish their state
+// through a seqlock, so this neither stops them nor sees half a change
+void * printer(void *arg)
+{
+	bool verbose = *(bool *)arg;
+	int n = table.cfg.n;
+	int shown = n < SHOWN? n : SHOWN;
+	struct dine_view *v = malloc(sizeof(struct dine_view) * n);
+
+	while(dining)
+	{
+		usleep(interval_ms*1000);
+		for(int i=0;i<n;i++)
+			dine_snapshot(&table, i, &v[i]);
+		if (verbose)
+			print_table(v, shown);
+		// the clock starts once everybody's seated
+		uint64_t start = __atomic_load_n(&table.start, __ATOMIC_RELAXED);
+		if (log_out)
+			print_line(v, n, start? (table.be->now() - start)/1000000 : 0);
+	}
+
+	free(v);
 	return 0;
 }
 
-// separate thread printer is doing printing every second to check if program meets the requirements.
-void * printer()
+// one strategy, one CSV line
+int dine(struct dine_cfg *cfg, const struct dine_backend *be, bool verbose)
 {
-	while(1)
-	{
-		sleep(1);	
-		fprintf(stdout,"Name:\t ");
-		for(int i=0;i<5;i++)
-			fprintf(stdout, "%10s\t",phi_name[i]);
-		fprintf(stdout,"\n");
-		
-		fprintf(stdout,"Forks got: ");
-		for(int i=0;i<5;i++)
-			fprintf(stdout, "%10d\t",phi_forks[i]);
-		fprintf(stdout,"\n");
-		
-		fprintf(stdout,"Name:\t ");
-		for(int i=0;i<5;i++)
-			switch(phi_status[i]){
-				case 0:
-				fprintf(stdout, " Blocking \t");
-				break;
-				
-				case 1:
-				fprintf(stdout, " Thinking \t");
-				break;
-				
-				case 2:
-				fprintf(stdout, "  Eating  \t");
-				break;
-				
-				default:
-				fprintf(stdout, "switch has sth wrong\n");
-			}
-		fprintf(stdout,"\n");
+	pthread_t thread_print;
 
-		fprintf(stdout, "----------------------------------------------\n");
+	if (dine_init(&table, cfg, be)) {
+		perror("can't set the table");
+		return -1;
 	}
-		
-	return 0;
+
+	bool monitor = verbose || log_out;
+
+	if (trace_file) {
+		char path[4096];
+		const char *name = dine_strategy_name(cfg->strategy);
+
+		if (trace_each)
+			snprintf(path, sizeof(path), "%s.%s", trace_file, name);
+		else
+			snprintf(path, sizeof(path), "%s", trace_file);
+		// sim's clock is the simulated one, anything else goes by the TSC
+		if (trace_open(path, cfg->n, name, be->name, be == &dine_sim? be->now : NULL)) {
+			perror(path);
+			dine_destroy(&table);
+			return -1;
+		}
+	}
+
+	dining = true;
+	if (monitor)
+		pthread_create(&thread_print, NULL, printer, &verbose);
+
+	uint64_t wall = now_ns();
+	int err = dine_run(&table);
+	uint64_t t = table.be->now();
+	wall = now_ns() - wall;
+	if (trace_file && trace_close())
+		err = -1;
+
+	dining = false;
+	if (monitor)
+		pthread_join(thread_print, NULL);
+
+	double secs = (t - table.start)/1e9;
+	dine_stats(&table, &stats);
+	printf("%s,%s,%d,%llu,%llu,%.3f,%ld,%.1f,%ld,%ld,%.4f,%llu,%llu,%llu,%llu,%.3f\n",
+		dine_strategy_name(cfg->strategy), table.be->name, cfg->n,
+		(unsigned long long)cfg->think_ns/1000, (unsigned long long)cfg->eat_ns/1000, secs,
+		stats.meals, stats.meals/secs, stats.meals_min, stats.meals_max, stats.fairness,
+		(unsigned long long)hist_percentile(&stats.wait, 50), (unsigned long long)hist_percentile(&stats.wait, 99),
+		(unsigned long long)stats.wait.max, (unsigned long long)stats.starve_max, wall/1e9);
+	fflush(stdout);
+
+	// past DINE_PHIL_HISTS philosophers there are no percentiles of their own
+	if (phil_out)
+		for (int i = 0; i < cfg->n; i++)
+		{
+			fprintf(phil_out, "%s,%d,%ld,", dine_strategy_name(cfg->strategy), i, table.phil[i].meals);
+			if (table.wait)
+				fprintf(phil_out, "%llu,%llu,", (unsigned long long)hist_percentile(&table.wait[i], 50),
+					(unsigned long long)hist_percentile(&table.wait[i], 99));
+			else
+				fprintf(phil_out, ",,");
+			fprintf(phil_out, "%llu,%llu\n", (unsigned long long)table.phil[i].wait_max,
+				(unsigned long long)table.phil[i].starve_max);
+		}
+
+	dine_destroy(&table);
+	return err;
 }
 
+void usage(char *name)
+{
+	printf("usage: %s [-n PHILOSOPHERS] [-s order|waiter|cm|trylock|all] [-t SECONDS] [-T THINK_US] [-E EAT_US] [-p FILE] [-m FILE] [-i MS] [-v]\n", name);
+	printf("       %*s [-b pthread|coro|sim] [-w WORKERS] [-k STACK_KB] [-r SEED] [-x FILE]\n", (int)strlen(name), "");
+	printf("  every philosopher thinks for THINK_US/2..3*THINK_US/2 and eats for EAT_US/2..3*EAT_US/2, for SECONDS\n");
+	printf("  prints a CSV line per strategy, all of them by default; -v adds the status table every second\n");
+	printf("  wait is hungry to eating, starve the longest stretch between meals, fairness is Jain's index of meals\n");
+	printf("  -p writes a CSV line per philosopher to FILE\n");
+	printf("  -m writes a snapshot of the table every MS (default %d) to FILE: strategy,ms,states,forks,meals\n", INTERVAL_MS);
+	printf("     with a letter per philosopher in states (Thinking, Hungry, Eating) and a digit in forks\n");
+	printf("  -b coro runs philosophers as coroutines on WORKERS threads (default one per cpu) with STACK_KB\n");
+	printf("     stacks (default %d), for tables of up to millions; pthread is a thread each\n", CORO_STACK/1024);
+	printf("  -b sim simulates the same on a virtual clock: SECONDS, THINK_US, EAT_US and all the times in the\n");
+	printf("     output are simulated, wall_seconds is how long it took. With -r the run repeats exactly\n");
+	printf("  -x records every state change and fork taken or put down to FILE (FILE.STRATEGY for more than\n");
+	printf("     one strategy), for dinetrace\n");
+}
 
 int main(int argc, char** argv)
 {
+	struct dine_cfg cfg = {
+		.n = PHILOSOPHERS,
+		.think_ns = THINK_US*1000ULL,
+		.eat_ns = EAT_US*1000ULL,
+		.duration_ns = SECONDS*1000000000ULL,
+	};
+	int strategy = -1;
+	bool verbose = false;
+	int opt;
+
+	char *phil_file = NULL;
+	char *log_file = NULL;
+	const struct dine_backend *be = &dine_pthreads;
+	int workers = 0;
+	int stack_kb = CORO_STACK/1024;
+	uint64_t seed = time(NULL);
 
-// 	if (argc != 3) {
-// 		fprintf(stdout, "incorrect number of arguments\n");
-// 		printf("input two arguments:1. No. of producers \n 2. No. of consumers  \n");
-// 		exit(EXIT_FAILURE);
-// 	}
-	
-	srand(time(NULL));
-	// I init all semaphores here and the flags for all philosophers.
-	sem_init(&sem_left, 0, 3);
-	sem_init(&sem_right,0,2);
-	
-	for(int i=0;i<5;i++)
+	while ((opt = getopt(argc, argv, "n:s:t:T:E:p:m:i:b:w:k:r:x:v")) != -1)
+	{
+		switch (opt)
 		{
-		sem_init(&sem_phi[i],0,1);
-		phi[i] = false;
-		phi_forks[i] = 0;
-		phi_status[i] = 0;
+			case 'n': cfg.n = atoi(optarg); break;
+			case 's':
+				if (!strcmp(optarg, "all"))
+					strategy = -1;
+				else if ((strategy = dine_strategy_parse(optarg)) < 0) {
+					usage(argv[0]);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 't': cfg.duration_ns = atof(optarg)*1e9; break;
+			case 'T': cfg.think_ns = atof(optarg)*1e3; break;
+			case 'E': cfg.eat_ns = atof(optarg)*1e3; break;
+			case 'p': phil_file = optarg; break;
+			case 'm': log_file = optarg; break;
+			case 'i': interval_ms = atoi(optarg); break;
+			case 'b':
+				if (!strcmp(optarg, "coro"))
+					be = &dine_coro;
+				else if (!strcmp(optarg, "sim"))
+					be = &dine_sim;
+				else if (strcmp(optarg, "pthread")) {
+					usage(argv[0]);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'w': workers = atoi(optarg); break;
+			case 'k': stack_kb = atoi(optarg); break;
+			case 'r': seed = strtoull(optarg, NULL, 0); break;
+			case 'x': trace_file = optarg; break;
+			case 'v': verbose = true; break;
+			default:
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
 		}
-		
-	phi_name[0] = "Dijkstra";
-	phi_name[1] = "Confucius";
-	phi_name[2] = "Li";
-	phi_name[3] = "Hafed";
-	phi_name[4] = "KingFaysal";
-	
-
-		
-		
-	
-	pthread_t threads[5];
-	pthread_t thread_print;
-	
-	int args[5];
-	for (int i=0; i<5; i++)
-		args[i] = i;
-
-	for (int i=0; i<5; i++)
-		pthread_create(&threads[i], NULL, philosopher, (void *)&args[i]);
-	
-	pthread_create(&thread_print, NULL, printer, NULL);
-
-	void* status;
-	for (int i=0; i<5; i++)
-		pthread_join(threads[i], &status);
-    
+	}
+	if (optind != argc || !interval_ms || stack_kb <= 0) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	if (be == &dine_sim && !cfg.think_ns && !cfg.eat_ns) {
+		fprintf(stderr, "simulated time only moves while philosophers think or eat\n");
+		exit(EXIT_FAILURE);
+	}
+	if (cfg.n < 2) {
+		fprintf(stderr, "need at least two philosophers\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (phil_file) {
+		if (!(phil_out = fopen(phil_file, "w"))) {
+			perror(phil_file);
+			exit(EXIT_FAILURE);
+		}
+		fprintf(phil_out, "strategy,philosopher,meals,wait_p50_ns,wait_p99_ns,wait_max_ns,starve_max_ns\n");
+	}
+
+	if (log_file) {
+		if (!(log_out = fopen(log_file, "w"))) {
+			perror(log_file);
+			exit(EXIT_FAILURE);
+		}
+		fprintf(log_out, "strategy,ms,states,forks,meals\n");
+	}
+
+	trace_each = strategy < 0;
+	dine_coro_setup(workers, stack_kb*1024);
+	printf("strategy,backend,philosophers,think_us,eat_us,seconds,meals,meals_per_sec,meals_min,meals_max,fairness,"
+		"wait_p50_ns,wait_p99_ns,wait_max_ns,starve_max_ns,wall_seconds\n");
+	for (int s = 0; s < DINE_STRATEGIES; s++)
+	{
+		if (strategy >= 0 && s != strategy)
+			continue;
+		cfg.strategy = s;
+		// every strategy gets the same random numbers
+		rt_srand(seed);
+		if (dine(&cfg, be, verbose))
+			exit(EXIT_FAILURE);
+	}
+
+	if (phil_out)
+		fclose(phil_out);
+	if (log_out)
+		fclose(log_out);
     return 0;
-}
\ No newline at end of file
+}
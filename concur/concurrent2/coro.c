@@ -0,0 +1,735 @@
+/*
+cs544 Concurrency 2 - coroutines on a small pool of threads
+*/
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "coro.h"
+#include "rt.h"
+
+#define CACHE_LINE 64
+
+// a coroutine that suspends with less than this left of its stack is
+// about to run off the end; for stacks past the guard page budget (see
+// start()) this is the only check there is
+#define CORO_STACK_SLACK 512
+
+// vm.max_map_count when /proc doesn't say
+#define DEFAULT_MAP_COUNT 65530
+
+#define GUARD_SPINS 64
+
+enum { PARK_EMPTY, PARK_PERMIT, PARK_WAITING };
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+
+/* Switching stacks. swapcontext() saves and restores the signal mask
+ * with a syscall each way, which is most of the cost of a switch; on
+ * x86-64 we save the callee-saved registers ourselves instead. A context
+ * is then just the stack pointer, with the registers pushed under it */
+
+#if defined(__x86_64__)
+
+struct ctx
+{
+	void *sp;
+};
+
+void coro_ctx_switch(struct ctx *from, struct ctx *to);
+__asm__(
+	".text\n"
+	".type coro_ctx_switch, @function\n"
+	"coro_ctx_switch:\n"
+	"	pushq %rbp\n"
+	"	pushq %rbx\n"
+	"	pushq %r12\n"
+	"	pushq %r13\n"
+	"	pushq %r14\n"
+	"	pushq %r15\n"
+	"	subq $8, %rsp\n"
+	"	stmxcsr (%rsp)\n"
+	"	fnstcw 4(%rsp)\n"
+	"	movq %rsp, (%rdi)\n"
+	"	movq (%rsi), %rsp\n"
+	"	ldmxcsr (%rsp)\n"
+	"	fldcw 4(%rsp)\n"
+	"	addq $8, %rsp\n"
+	"	popq %r15\n"
+	"	popq %r14\n"
+	"	popq %r13\n"
+	"	popq %r12\n"
+	"	popq %rbx\n"
+	"	popq %rbp\n"
+	"	ret\n"
+	".size coro_ctx_switch, .-coro_ctx_switch\n");
+
+#define ctx_switch coro_ctx_switch
+
+// the first switch to a new context "returns" into entry(), as if it had
+// been called (rsp is 8 off 16-byte alignment on entry)
+static void ctx_make(struct ctx *c, char *stack, size_t size, void (*entry)(void))
+{
+	uint64_t *sp = (uint64_t *)(((uintptr_t)stack + size) & ~(uintptr_t)15);
+
+	*--sp = 0;	// entry's return address, it never returns
+	*--sp = (uint64_t)entry;
+	for (int r = 0; r < 6; r++)
+		*--sp = 0;
+	*--sp = 0x037f00001f80ull;	// default x87 control word, default mxcsr
+	c->sp = sp;
+}
+
+#else
+
+struct ctx
+{
+	ucontext_t uc;
+};
+
+static void ctx_switch(struct ctx *from, struct ctx *to)
+{
+	swapcontext(&from->uc, &to->uc);
+}
+
+static void ctx_make(struct ctx *c, char *stack, size_t size, void (*entry)(void))
+{
+	getcontext(&c->uc);
+	c->uc.uc_stack.ss_sp = stack;
+	c->uc.uc_stack.ss_size = size;
+	c->uc.uc_link = NULL;
+	makecontext(&c->uc, entry, 0);
+}
+
+#endif
+
+struct coro
+{
+	struct ctx ctx;
+	int i;
+	int started;
+	char *stack;
+	struct coro *next;	// in a run queue or a mutex's waiters
+	uint64_t wake_at;	// asleep in a timer heap until then
+	// The worker runs this once the coroutine is off its stack; 0 puts it
+	// straight back in the run queue. This is how a coroutine publishes
+	// that it's waiting without anybody resuming it while it's still
+	// running
+	int (*commit)(struct coro *c, void *arg);
+	void *commit_arg;
+};
+
+struct worker
+{
+	pthread_mutex_t lock;	// over the run queue
+	struct coro *head;
+	struct coro *tail;
+	int len;
+	// sleeping coroutines, a min-heap on wake_at. Only the owner touches it
+	struct coro **timers;
+	int ntimers;
+	int timers_cap;
+	struct ctx sched;
+	struct coro *cur;
+	pthread_t thread;
+	int id;
+} __attribute__((aligned(CACHE_LINE)));
+
+static struct
+{
+	int n;
+	int workers;
+	void (*fn)(void *arg, int i);
+	void *arg;
+	struct coro *coros;
+	char *stacks;
+	size_t stack;
+	size_t slot;	// stack plus its guard page
+	struct worker *w;
+	int live;	// coroutines not finished yet
+	// simulation: one worker, and time is whatever the next timer says
+	int sim;
+	uint64_t vnow;
+	// idle workers sleep on seq, whoever makes work for them bumps it
+	uint32_t seq __attribute__((aligned(CACHE_LINE)));
+	int idle;
+} S;
+
+static __thread struct worker *self_w;
+
+static long futex(uint32_t *addr, int op, uint32_t val, const struct timespec *ts)
+{
+	return syscall(SYS_futex, addr, op, val, ts, NULL, 0);
+}
+
+uint64_t coro_now(void)
+{
+	if (S.sim)
+		return __atomic_load_n(&S.vnow, __ATOMIC_RELAXED);
+	return now_ns();
+}
+
+// A coroutine can come back on another worker after a switch, so it must
+// not keep a worker it looked up before the switch. noinline keeps the
+// compiler from doing that for us
+static __attribute__((noinline)) struct worker *cur_worker(void)
+{
+	return self_w;
+}
+
+struct coro *coro_self(void)
+{
+	struct worker *w = cur_worker();
+	return w? w->cur : NULL;
+}
+
+/* run queues */
+
+static void push(struct worker *w, struct coro *c)
+{
+	c->next = NULL;
+	pthread_mutex_lock(&w->lock);
+	if (w->tail)
+		w->tail->next = c;
+	else
+		w->head = c;
+	w->tail = c;
+	w->len++;
+	pthread_mutex_unlock(&w->lock);
+}
+
+static struct coro *pop(struct worker *w)
+{
+	struct coro *c;
+
+	if (!__atomic_load_n(&w->len, __ATOMIC_RELAXED))
+		return NULL;
+	pthread_mutex_lock(&w->lock);
+	c = w->head;
+	if (c)
+	{
+		w->head = c->next;
+		if (!w->head)
+			w->tail = NULL;
+		w->len--;
+	}
+	pthread_mutex_unlock(&w->lock);
+	return c;
+}
+
+// take half of somebody else's queue, run the first one
+static struct coro *steal(struct worker *w)
+{
+	for (int k = 1; k < S.workers; k++)
+	{
+		struct worker *v = &S.w[(w->id + k) % S.workers];
+		struct coro *first, *last;
+		int take;
+
+		if (!__atomic_load_n(&v->len, __ATOMIC_RELAXED))
+			continue;
+		pthread_mutex_lock(&v->lock);
+		take = (v->len + 1) / 2;
+		first = last = v->head;
+		if (!first)
+		{
+			pthread_mutex_unlock(&v->lock);
+			continue;
+		}
+		for (int j = 1; j < take; j++)
+			last = last->next;
+		v->head = last->next;
+		if (!v->head)
+			v->tail = NULL;
+		v->len -= take;
+		pthread_mutex_unlock(&v->lock);
+
+		// keep the rest, hand back the first
+		last->next = NULL;
+		for (struct coro *c = first->next, *next; c; c = next)
+		{
+			next = c->next;
+			push(w, c);
+		}
+		return first;
+	}
+	return NULL;
+}
+
+// let one idle worker know there's something to take
+static void notify(void)
+{
+	if (__atomic_load_n(&S.idle, __ATOMIC_SEQ_CST))
+	{
+		__atomic_add_fetch(&S.seq, 1, __ATOMIC_SEQ_CST);
+		futex(&S.seq, FUTEX_WAKE_PRIVATE, 1, NULL);
+	}
+}
+
+static void ready(struct coro *c)
+{
+	struct worker *w = cur_worker();
+
+	push(w? w : &S.w[c->i % S.workers], c);
+	notify();
+}
+
+/* timer heap */
+
+static void timer_push(struct worker *w, struct coro *c)
+{
+	if (w->ntimers == w->timers_cap)
+	{
+		w->timers_cap = w->timers_cap? w->timers_cap*2 : 64;
+		w->timers = realloc(w->timers, sizeof(struct coro *) * w->timers_cap);
+		if (!w->timers)
+		{
+			fprintf(stderr, "out of memory for timers\n");
+			abort();
+		}
+	}
+
+	int k = w->ntimers++;
+	while (k > 0)
+	{
+		int up = (k - 1) / 2;
+		if (w->timers[up]->wake_at <= c->wake_at)
+			break;
+		w->timers[k] = w->timers[up];
+		k = up;
+	}
+	w->timers[k] = c;
+}
+
+static struct coro *timer_pop(struct worker *w)
+{
+	struct coro *top = w->timers[0];
+	struct coro *c = w->timers[--w->ntimers];
+	int k = 0;
+
+	for (;;)
+	{
+		int kid = 2*k + 1;
+		if (kid >= w->ntimers)
+			break;
+		if (kid + 1 < w->ntimers && w->timers[kid + 1]->wake_at < w->timers[kid]->wake_at)
+			kid++;
+		if (c->wake_at <= w->timers[kid]->wake_at)
+			break;
+		w->timers[k] = w->timers[kid];
+		k = kid;
+	}
+	if (w->ntimers)
+		w->timers[k] = c;
+	return top;
+}
+
+// everything due goes to the run queue; ns until the next one, or 0
+static uint64_t timers_fire(struct worker *w)
+{
+	if (!w->ntimers)
+		return 0;
+
+	uint64_t t = coro_now();
+	int woke = 0;
+
+	while (w->ntimers && w->timers[0]->wake_at <= t)
+	{
+		push(w, timer_pop(w));
+		woke++;
+	}
+	if (woke > 1)
+		notify();
+	return w->ntimers? w->timers[0]->wake_at - t : 0;
+}
+
+/* switching */
+
+static void suspend(int (*commit)(struct coro *c, void *arg), void *arg)
+{
+	struct worker *w = cur_worker();
+	struct coro *c = w->cur;
+	char here;
+
+	if (&here < c->stack + CORO_STACK_SLACK)
+	{
+		fprintf(stderr, "coroutine %d ran out of stack\n", c->i);
+		abort();
+	}
+	c->commit = commit;
+	c->commit_arg = arg;
+	ctx_switch(&c->ctx, &w->sched);
+}
+
+static int commit_requeue(struct coro *c, void *arg)
+{
+	return 0;
+}
+
+static int commit_done(struct coro *c, void *arg)
+{
+	if (__atomic_sub_fetch(&S.live, 1, __ATOMIC_SEQ_CST) == 0)
+	{
+		__atomic_add_fetch(&S.seq, 1, __ATOMIC_SEQ_CST);
+		futex(&S.seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL);
+	}
+	return 1;
+}
+
+static void coro_main(void)
+{
+	S.fn(S.arg, coro_self()->i);
+	suspend(commit_done, NULL);
+}
+
+static void run(struct worker *w, struct coro *c)
+{
+	if (!c->started)
+	{
+		// contexts are made on first run, so a million coroutines don't
+		// touch a million stacks before anything happens
+		ctx_make(&c->ctx, c->stack, S.stack, coro_main);
+		c->started = 1;
+	}
+
+	w->cur = c;
+	ctx_switch(&w->sched, &c->ctx);
+	w->cur = NULL;
+
+	// from here on somebody else may be running c
+	int (*commit)(struct coro *, void *) = c->commit;
+	c->commit = NULL;
+	if (!commit(c, c->commit_arg))
+		push(w, c);
+}
+
+static void *worker_main(void *arg)
+{
+	struct worker *w = arg;
+
+	self_w = w;
+	for (;;)
+	{
+		uint64_t next = timers_fire(w);
+		struct coro *c = pop(w);
+
+		if (!c)
+			c = steal(w);
+		if (c)
+		{
+			run(w, c);
+			continue;
+		}
+		if (!__atomic_load_n(&S.live, __ATOMIC_SEQ_CST))
+			break;
+
+		// simulated time doesn't pass while anybody can run, and jumps
+		// to the next timer when nobody can
+		if (S.sim)
+		{
+			if (!w->ntimers)
+			{
+				fprintf(stderr, "simulation stuck: %d coroutines blocked and no timer pending\n", S.live);
+				exit(EXIT_FAILURE);
+			}
+			__atomic_store_n(&S.vnow, w->timers[0]->wake_at, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		// nothing to do: say so, look once more, then sleep until somebody
+		// makes work or this worker's next timer is due
+		uint32_t seq = __atomic_load_n(&S.seq, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&S.idle, 1, __ATOMIC_SEQ_CST);
+		c = pop(w);
+		if (!c)
+			c = steal(w);
+		if (!c && __atomic_load_n(&S.live, __ATOMIC_SEQ_CST))
+		{
+			struct timespec ts = { next / 1000000000, next % 1000000000 };
+			futex(&S.seq, FUTEX_WAIT_PRIVATE, seq, next? &ts : NULL);
+		}
+		__atomic_sub_fetch(&S.idle, 1, __ATOMIC_SEQ_CST);
+		if (c)
+			run(w, c);
+	}
+	self_w = NULL;
+	return NULL;
+}
+
+// stacks that can have a guard page. The kernel allows vm.max_map_count
+// mappings per process, and each guard costs two: it splits the stack
+// mapping into itself and the stacks above it. An eighth of the limit
+// in guards is a quarter of it in mappings, the rest is left for
+// malloc, thread stacks and everything else
+static int guard_budget(void)
+{
+	FILE *f = fopen("/proc/sys/vm/max_map_count", "r");
+	int max = 0;
+
+	if (f)
+	{
+		if (fscanf(f, "%d", &max) != 1)
+			max = 0;
+		fclose(f);
+	}
+	if (max <= 0)
+		max = DEFAULT_MAP_COUNT;
+	return max / 8;
+}
+
+static int start(int workers, int n, size_t stack, void (*fn)(void *arg, int i), void *arg, int sim)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	int up = 0;
+
+	if (workers <= 0)
+		workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (workers <= 0)
+		workers = 1;
+	if (!stack)
+		stack = CORO_STACK;
+	stack = (stack + page - 1) / page * page;
+
+	memset(&S, 0, sizeof(S));
+	S.n = n;
+	S.workers = workers;
+	S.fn = fn;
+	S.arg = arg;
+	S.stack = stack;
+	S.slot = stack + page;
+	S.live = n;
+	S.sim = sim;
+	S.vnow = now_ns();
+
+	// One mapping for every stack, only backed where it's touched, with a
+	// PROT_NONE page under each stack so running off the end faults right
+	// there. Past guard_budget() stacks keep the page but not the
+	// protection, and suspend() checking the stack pointer is all they get
+	S.stacks = mmap(NULL, S.slot * n, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+	if (S.stacks == MAP_FAILED)
+		return -1;
+	S.coros = calloc(n, sizeof(struct coro));
+	if (posix_memalign((void **)&S.w, CACHE_LINE, sizeof(struct worker) * workers) || !S.coros)
+	{
+		munmap(S.stacks, S.slot * n);
+		free(S.coros);
+		return -1;
+	}
+	for (int i = 0, guards = guard_budget(); i < n && i < guards; i++)
+		if (mprotect(S.stacks + S.slot * i, page, PROT_NONE))
+			break;
+	memset(S.w, 0, sizeof(struct worker) * workers);
+
+	for (int k = 0; k < workers; k++)
+	{
+		pthread_mutex_init(&S.w[k].lock, NULL);
+		S.w[k].id = k;
+	}
+	for (int i = 0; i < n; i++)
+	{
+		struct coro *c = &S.coros[i];
+
+		c->i = i;
+		c->stack = S.stacks + S.slot * i + page;
+		push(&S.w[i % workers], c);
+	}
+
+	// whoever does start steals the queues of those that didn't
+	for (; up < workers; up++)
+		if (pthread_create(&S.w[up].thread, NULL, worker_main, &S.w[up]))
+			break;
+	if (up < workers)
+		S.workers = up;
+	for (int k = 0; k < up; k++)
+		pthread_join(S.w[k].thread, NULL);
+
+	for (int k = 0; k < workers; k++)
+	{
+		pthread_mutex_destroy(&S.w[k].lock);
+		free(S.w[k].timers);
+	}
+	free(S.w);
+	free(S.coros);
+	munmap(S.stacks, S.slot * n);
+	return up? 0 : -1;
+}
+
+int coro_run(int workers, int n, size_t stack, void (*fn)(void *arg, int i), void *arg)
+{
+	return start(workers, n, stack, fn, arg, 0);
+}
+
+int coro_run_sim(int n, size_t stack, void (*fn)(void *arg, int i), void *arg)
+{
+	return start(1, n, stack, fn, arg, 1);
+}
+
+/* what coroutines call */
+
+void coro_yield(void)
+{
+	suspend(commit_requeue, NULL);
+}
+
+static int commit_sleep(struct coro *c, void *arg)
+{
+	timer_push(cur_worker(), c);
+	return 1;
+}
+
+void coro_sleep(uint64_t ns)
+{
+	struct coro *c = coro_self();
+
+	if (!ns)
+	{
+		coro_yield();
+		return;
+	}
+	c->wake_at = coro_now() + ns;
+	suspend(commit_sleep, NULL);
+}
+
+void coro_parker_init(struct coro_parker *p)
+{
+	p->state = PARK_EMPTY;
+	p->waiter = NULL;
+}
+
+static int commit_park(struct coro *c, void *arg)
+{
+	struct coro_parker *p = arg;
+	uint32_t empty = PARK_EMPTY;
+
+	if (__atomic_compare_exchange_n(&p->state, &empty, PARK_WAITING, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		return 1;
+	// an unpark came in while we were on our way out, take it and go on
+	__atomic_store_n(&p->state, PARK_EMPTY, __ATOMIC_RELAXED);
+	return 0;
+}
+
+void coro_park(struct coro_parker *p)
+{
+	uint32_t permit = PARK_PERMIT;
+
+	if (__atomic_compare_exchange_n(&p->state, &permit, PARK_EMPTY, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return;
+	p->waiter = coro_self();
+	suspend(commit_park, p);
+}
+
+void coro_unpark(struct coro_parker *p)
+{
+	for (;;)
+	{
+		uint32_t s = __atomic_load_n(&p->state, __ATOMIC_ACQUIRE);
+
+		if (s == PARK_PERMIT)
+			return;
+		if (s == PARK_EMPTY
+			&& __atomic_compare_exchange_n(&p->state, &s, PARK_PERMIT, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			return;
+		if (s == PARK_WAITING
+			&& __atomic_compare_exchange_n(&p->state, &s, PARK_EMPTY, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		{
+			ready(p->waiter);
+			return;
+		}
+	}
+}
+
+void coro_mutex_init(struct coro_mutex *m)
+{
+	memset(m, 0, sizeof(*m));
+}
+
+static void guard_lock(struct coro_mutex *m)
+{
+	int spins = 0;
+
+	while (__atomic_exchange_n(&m->guard, 1, __ATOMIC_ACQUIRE))
+		if (++spins < GUARD_SPINS)
+			cpu_relax();
+		else
+			sched_yield();
+}
+
+static void guard_unlock(struct coro_mutex *m)
+{
+	__atomic_store_n(&m->guard, 0, __ATOMIC_RELEASE);
+}
+
+// the waiter is queued under the guard; let go of it only once the
+// waiter is off its stack, or the unlocker could resume it too early
+static int commit_unguard(struct coro *c, void *arg)
+{
+	guard_unlock(arg);
+	return 1;
+}
+
+void coro_mutex_lock(struct coro_mutex *m)
+{
+	struct coro *c = coro_self();
+
+	guard_lock(m);
+	if (!m->locked)
+	{
+		m->locked = 1;
+		guard_unlock(m);
+		return;
+	}
+	c->next = NULL;
+	if (m->tail)
+		m->tail->next = c;
+	else
+		m->head = c;
+	m->tail = c;
+	// when we're back, the unlocker has handed us the mutex
+	suspend(commit_unguard, m);
+}
+
+int coro_mutex_trylock(struct coro_mutex *m)
+{
+	int got = 0;
+
+	guard_lock(m);
+	if (!m->locked)
+		got = m->locked = 1;
+	guard_unlock(m);
+	return got;
+}
+
+void coro_mutex_unlock(struct coro_mutex *m)
+{
+	guard_lock(m);
+	struct coro *c = m->head;
+	if (c)
+	{
+		m->head = c->next;
+		if (!m->head)
+			m->tail = NULL;
+	}
+	else
+		m->locked = 0;
+	guard_unlock(m);
+
+	if (c)
+		ready(c);
+}
@@ -0,0 +1,77 @@
+/*
+cs544 Concurrency 2 - coroutines on a small pool of threads
+
+coro_run() starts N coroutines on M worker threads (M:N) and returns when
+all of them have returned. Every worker has its own run queue and timer
+heap; a worker with nothing to run steals from the others. A coroutine
+that blocks (mutex, park, sleep) gives its worker back instead of the
+thread going to sleep in the kernel.
+
+Stacks come out of one big lazily-backed mapping, so a coroutine costs
+its struct (under 64 bytes on x86-64, the context is a stack pointer)
+plus the stack pages it actually touches, about 4k in all for one that
+stays near the top of its stack. The first few thousand stacks have a
+guard page under them, the kernel's limit on mappings doesn't leave
+room for more.
+*/
+#ifndef CORO_H
+#define CORO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CORO_STACK (16*1024)
+
+struct coro;
+
+// run fn(arg, i) for i in 0..n-1 on `workers` threads (0: one per cpu),
+// each with a stack of `stack` bytes (0: CORO_STACK). -1 if it couldn't
+// start, in which case none of them ran
+int coro_run(int workers, int n, size_t stack, void (*fn)(void *arg, int i), void *arg);
+
+// Discrete-event simulation: the same, on one thread and a virtual
+// clock. Running takes no time; when every coroutine is blocked the clock
+// jumps to the earliest sleeper. Stops the program if they're all
+// blocked and none is asleep, which would hang for real
+int coro_run_sim(int n, size_t stack, void (*fn)(void *arg, int i), void *arg);
+
+// the clock coro_sleep() goes by: CLOCK_MONOTONIC, or the simulated one
+uint64_t coro_now(void);
+
+// the running coroutine, NULL outside of one
+struct coro *coro_self(void);
+
+// back of the run queue
+void coro_yield(void);
+// off the run queue for at least `ns`
+void coro_sleep(uint64_t ns);
+
+// Park with a permit, like the parker of a thread: coro_unpark() before
+// coro_park() leaves the permit, which the park then takes without
+// blocking. Only the owner parks
+struct coro_parker
+{
+	uint32_t state;
+	struct coro *waiter;
+};
+
+void coro_parker_init(struct coro_parker *p);
+void coro_park(struct coro_parker *p);
+void coro_unpark(struct coro_parker *p);
+
+// FIFO mutex. A coroutine waiting for it is parked, and unlock hands the
+// mutex straight to the first waiter
+struct coro_mutex
+{
+	uint32_t guard;	// spinlock over the rest, held for a few instructions
+	int locked;
+	struct coro *head;
+	struct coro *tail;
+};
+
+void coro_mutex_init(struct coro_mutex *m);
+void coro_mutex_lock(struct coro_mutex *m);
+int coro_mutex_trylock(struct coro_mutex *m);	// 1 if taken
+void coro_mutex_unlock(struct coro_mutex *m);
+
+#endif
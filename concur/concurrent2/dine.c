@@ -0,0 +1,505 @@
+/*
+cs544 Concurrency 2 - dining philosophers engine and strategies
+*/
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dine.h"
+#include "rt.h"
+#include "trace.h"
+
+// trylock: first backoff after a failed try, it doubles up to the mean
+// eating time (that's what we're waiting for)
+#define BACKOFF_MIN_NS 1000
+
+static const char *strategy_names[DINE_STRATEGIES] = { "order", "waiter", "cm", "trylock" };
+
+const char *dine_strategy_name(int strategy)
+{
+	if (strategy < 0 || strategy >= DINE_STRATEGIES)
+		return "?";
+	return strategy_names[strategy];
+}
+
+int dine_strategy_parse(const char *name)
+{
+	for (int s = 0; s < DINE_STRATEGIES; s++)
+		if (!strcmp(name, strategy_names[s]))
+			return s;
+	return -1;
+}
+
+// philosopher i eats with fork i and fork i+1
+static inline int left_fork(struct dine *d, int i)
+{
+	return i;
+}
+
+static inline int right_fork(struct dine *d, int i)
+{
+	return (i + 1) % d->cfg.n;
+}
+
+static inline int left_of(struct dine *d, int i)
+{
+	return (i + d->cfg.n - 1) % d->cfg.n;
+}
+
+static inline int right_of(struct dine *d, int i)
+{
+	return (i + 1) % d->cfg.n;
+}
+
+// uniform in [x/2, 3x/2]
+static uint64_t rand_ns(uint64_t x)
+{
+	if (!x)
+		return 0;
+	uint64_t r = (uint64_t)rt_rand() << 32 | rt_rand();
+	return x/2 + r % (x + 1);
+}
+
+// Everything a monitor reads about a philosopher is written by that
+// philosopher alone, so a sequence count is enough to give readers a
+// consistent view: odd while a change is under way, and a reader who saw
+// it move tries again. Writers pay two plain stores, no locked op
+static void publish(struct dine_phil *p, int state, int held, long meals)
+{
+	uint32_t seq = p->seq;
+
+	__atomic_store_n(&p->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&p->state, state, __ATOMIC_RELAXED);
+	__atomic_store_n(&p->held, held, __ATOMIC_RELAXED);
+	__atomic_store_n(&p->meals, meals, __ATOMIC_RELAXED);
+	__atomic_store_n(&p->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void set_state(struct dine_phil *p, int state)
+{
+	publish(p, state, p->held, p->meals);
+}
+
+static void set_held(struct dine_phil *p, int held)
+{
+	publish(p, p->state, held, p->meals);
+}
+
+// a fork's lock is the fork, for the forks that work that way. Letting
+// go is traced first, or the next holder could show up before we left
+static void fork_lock(struct dine *d, int i, int f)
+{
+	trace(i, TRACE_WAIT, f);
+	d->be->lock(d->forks[f].lock);
+	trace(i, TRACE_ACQ, f);
+}
+
+static void fork_unlock(struct dine *d, int i, int f)
+{
+	trace(i, TRACE_REL, f);
+	d->be->unlock(d->forks[f].lock);
+}
+
+/* order: every philosopher takes the lower numbered of its forks first,
+ * so the last one reaches for the same first fork as the first one and
+ * the circle of waiting can't close */
+
+static void order_take(struct dine *d, int i)
+{
+	int a = left_fork(d, i), b = right_fork(d, i);
+
+	if (a > b)
+	{
+		int t = a;
+		a = b;
+		b = t;
+	}
+	fork_lock(d, i, a);
+	set_held(&d->phil[i], 1);
+	fork_lock(d, i, b);
+	set_held(&d->phil[i], 2);
+}
+
+static void forks_put(struct dine *d, int i)
+{
+	fork_unlock(d, i, right_fork(d, i));
+	fork_unlock(d, i, left_fork(d, i));
+	set_held(&d->phil[i], 0);
+}
+
+/* waiter: Dijkstra's solution. Everybody's state sits behind one lock;
+ * a hungry philosopher eats only when neither neighbour does, and whoever
+ * stops eating checks whether that lets a neighbour start. The fork locks
+ * are still taken, but the arbitrator makes sure nobody waits on them */
+
+// under monitor
+static void waiter_test(struct dine *d, int k)
+{
+	struct dine_phil *p = d->phil;
+
+	if (p[k].wstate == DINE_HUNGRY
+		&& p[left_of(d, k)].wstate != DINE_EATING
+		&& p[right_of(d, k)].wstate != DINE_EATING)
+	{
+		p[k].wstate = DINE_EATING;
+		d->be->unpark(p[k].parker);
+	}
+}
+
+static void waiter_take(struct dine *d, int i)
+{
+	d->be->lock(d->monitor);
+	d->phil[i].wstate = DINE_HUNGRY;
+	waiter_test(d, i);
+	d->be->unlock(d->monitor);
+
+	// one grant per hunger, one unpark per grant, so this never returns
+	// on somebody else's leftover permit
+	d->be->park(d->phil[i].parker);
+
+	fork_lock(d, i, left_fork(d, i));
+	fork_lock(d, i, right_fork(d, i));
+	set_held(&d->phil[i], 2);
+}
+
+static void waiter_put(struct dine *d, int i)
+{
+	forks_put(d, i);
+
+	d->be->lock(d->monitor);
+	d->phil[i].wstate = DINE_THINKING;
+	waiter_test(d, left_of(d, i));
+	waiter_test(d, right_of(d, i));
+	d->be->unlock(d->monitor);
+}
+
+/* cm: Chandy-Misra. Every fork belongs to one of its two philosophers and
+ * is dirty once eaten with. A dirty fork that isn't being eaten with goes
+ * to the neighbour who wants it, and is clean when it gets there; a clean
+ * one stays, and the neighbour leaves a request. After eating, requested
+ * forks are handed over. Forks start dirty, each with the lower numbered
+ * of its two philosophers, so nobody waits in a circle and a hungry
+ * philosopher's forks stay clean until it has eaten: nobody starves.
+ * A fork's lock only guards its bookkeeping for a moment, nobody blocks
+ * on it while holding the other */
+
+static void cm_lock_pair(struct dine *d, int i)
+{
+	int a = left_fork(d, i), b = right_fork(d, i);
+
+	d->be->lock(d->forks[a < b? a : b].lock);
+	d->be->lock(d->forks[a < b? b : a].lock);
+}
+
+static void cm_unlock_pair(struct dine *d, int i)
+{
+	d->be->unlock(d->forks[left_fork(d, i)].lock);
+	d->be->unlock(d->forks[right_fork(d, i)].lock);
+}
+
+// under the fork's lock, 1 if i has it now
+static int cm_want(struct dine_fork *f, int i)
+{
+	if (f->owner == i)
+		return 1;
+	if (f->dirty && !f->in_use)
+	{
+		f->owner = i;
+		f->dirty = 0;
+		if (f->req == i)
+			f->req = -1;
+		return 1;
+	}
+	f->req = i;
+	return 0;
+}
+
+static void cm_take(struct dine *d, int i)
+{
+	struct dine_fork *l = &d->forks[left_fork(d, i)];
+	struct dine_fork *r = &d->forks[right_fork(d, i)];
+
+	for (;;)
+	{
+		cm_lock_pair(d, i);
+		int got_l = cm_want(l, i), got_r = cm_want(r, i);
+		if (got_l && got_r)
+		{
+			l->in_use = r->in_use = 1;
+			trace(i, TRACE_ACQ, left_fork(d, i));
+			trace(i, TRACE_ACQ, right_fork(d, i));
+		}
+		cm_unlock_pair(d, i);
+
+		set_held(&d->phil[i], got_l + got_r);
+		if (got_l && got_r)
+			return;
+		if (!got_l)
+			trace(i, TRACE_WAIT, left_fork(d, i));
+		if (!got_r)
+			trace(i, TRACE_WAIT, right_fork(d, i));
+		// a handover after the unlock leaves a permit, so this can't miss
+		// it; an old permit just means one more look at the forks
+		d->be->park(d->phil[i].parker);
+	}
+}
+
+// under the fork's lock, who to wake or -1
+static int cm_release(struct dine_fork *f)
+{
+	int to = f->req;
+
+	f->in_use = 0;
+	f->dirty = 1;
+	if (to < 0)
+		return -1;
+	f->owner = to;
+	f->dirty = 0;
+	f->req = -1;
+	return to;
+}
+
+static void cm_put(struct dine *d, int i)
+{
+	cm_lock_pair(d, i);
+	trace(i, TRACE_REL, left_fork(d, i));
+	trace(i, TRACE_REL, right_fork(d, i));
+	int wl = cm_release(&d->forks[left_fork(d, i)]);
+	int wr = cm_release(&d->forks[right_fork(d, i)]);
+	cm_unlock_pair(d, i);
+
+	set_held(&d->phil[i], 0);
+	if (wl >= 0)
+		d->be->unpark(d->phil[wl].parker);
+	if (wr >= 0 && wr != wl)
+		d->be->unpark(d->phil[wr].parker);
+}
+
+/* trylock: hold the left fork, try the right one. If it's taken put the
+ * left one down too and wait a random while before trying again, twice
+ * as long at most each time, so two neighbours don't keep colliding */
+
+static void trylock_take(struct dine *d, int i)
+{
+	int l = left_fork(d, i), r = right_fork(d, i);
+	uint64_t cap = d->cfg.eat_ns > BACKOFF_MIN_NS? d->cfg.eat_ns : BACKOFF_MIN_NS;
+	uint64_t backoff = BACKOFF_MIN_NS;
+
+	for (;;)
+	{
+		fork_lock(d, i, l);
+		set_held(&d->phil[i], 1);
+		if (d->be->trylock(d->forks[r].lock))
+			break;
+		fork_unlock(d, i, l);
+		set_held(&d->phil[i], 0);
+
+		uint64_t rnd = (uint64_t)rt_rand() << 32 | rt_rand();
+		d->be->delay(rnd % (backoff + 1));
+		backoff = backoff*2 < cap? backoff*2 : cap;
+	}
+	trace(i, TRACE_ACQ, r);
+	set_held(&d->phil[i], 2);
+}
+
+static void take_forks(struct dine *d, int i)
+{
+	switch (d->cfg.strategy)
+	{
+		case DINE_ORDER: order_take(d, i); break;
+		case DINE_WAITER: waiter_take(d, i); break;
+		case DINE_CM: cm_take(d, i); break;
+		case DINE_TRYLOCK: trylock_take(d, i); break;
+	}
+}
+
+static void put_forks(struct dine *d, int i)
+{
+	switch (d->cfg.strategy)
+	{
+		case DINE_WAITER: waiter_put(d, i); break;
+		case DINE_CM: cm_put(d, i); break;
+		default: forks_put(d, i); break;
+	}
+}
+
+static void enter(struct dine *d, int i, int state)
+{
+	set_state(&d->phil[i], state);
+	trace(i, TRACE_STATE, state);
+}
+
+static void starved(struct dine_phil *p, uint64_t since, uint64_t t)
+{
+	if (t - since > p->starve_max)
+		p->starve_max = t - since;
+}
+
+// think, get hungry, eat, until time is up. A philosopher starves from
+// the end of one meal (or from sitting down) to the start of the next,
+// and the stretch it leaves the table in counts too
+static void philosopher(void *arg, int i)
+{
+	struct dine *d = arg;
+	struct dine_phil *p = &d->phil[i];
+	const struct dine_backend *be = d->be;
+	uint64_t fed, t;
+
+	// nobody starts before everybody's seated, or the first ones in eat
+	// while the rest are still being started. The last one to sit starts
+	// the clock and wakes philosopher 0, and everybody wakes two more
+	// before anything else, so the table fills in log n rounds rather
+	// than one waker going round n seats
+	if (__atomic_add_fetch(&d->seated, 1, __ATOMIC_ACQ_REL) == d->cfg.n)
+	{
+		d->start = be->now();
+		d->end = d->start + d->cfg.duration_ns;
+		be->unpark(d->phil[0].parker);
+	}
+	be->park(p->parker);
+	for (int k = 2*i + 1; k <= 2*i + 2 && k < d->cfg.n; k++)
+		be->unpark(d->phil[k].parker);
+	fed = d->start;
+
+	while ((t = be->now()) < d->end)
+	{
+		enter(d, i, DINE_THINKING);
+		be->delay(rand_ns(d->cfg.think_ns));
+
+		uint64_t hungry = be->now();
+		enter(d, i, DINE_HUNGRY);
+		take_forks(d, i);
+
+		publish(p, DINE_EATING, p->held, p->meals + 1);
+		trace(i, TRACE_STATE, DINE_EATING);
+		t = be->now();
+		if (t - hungry > p->wait_max)
+			p->wait_max = t - hungry;
+		if (d->wait)
+			hist_add(&d->wait[i], t - hungry);
+		else
+			hist_add_atomic(&d->wait_shared[i % DINE_WAIT_SHARDS], t - hungry);
+		starved(p, fed, t);
+		be->delay(rand_ns(d->cfg.eat_ns));
+		put_forks(d, i);
+		fed = be->now();
+	}
+	starved(p, fed, t);
+	enter(d, i, DINE_THINKING);
+}
+
+int dine_init(struct dine *d, const struct dine_cfg *cfg, const struct dine_backend *be)
+{
+	int n = cfg->n;
+
+	memset(d, 0, sizeof(*d));
+	if (n < 2 || cfg->strategy < 0 || cfg->strategy >= DINE_STRATEGIES)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	d->cfg = *cfg;
+	d->be = be;
+
+	if (posix_memalign((void **)&d->forks, CACHE_LINE, sizeof(struct dine_fork) * n)
+		|| posix_memalign((void **)&d->phil, CACHE_LINE, sizeof(struct dine_phil) * n)
+		|| !(n <= DINE_PHIL_HISTS? (d->wait = calloc(n, sizeof(struct hist)))
+			: (d->wait_shared = calloc(DINE_WAIT_SHARDS, sizeof(struct hist)))))
+	{
+		free(d->forks);
+		free(d->phil);
+		errno = ENOMEM;
+		return -1;
+	}
+	memset(d->forks, 0, sizeof(struct dine_fork) * n);
+	memset(d->phil, 0, sizeof(struct dine_phil) * n);
+
+	for (int f = 0; f < n; f++)
+	{
+		// fork f lies between philosophers f-1 and f
+		d->forks[f].lock = be->lock_new();
+		d->forks[f].owner = f == 0? 0 : f - 1;
+		d->forks[f].dirty = 1;
+		d->forks[f].req = -1;
+	}
+	for (int i = 0; i < n; i++)
+		d->phil[i].parker = be->parker_new();
+	d->monitor = be->lock_new();
+	return 0;
+}
+
+int dine_run(struct dine *d)
+{
+	d->seated = 0;
+	return d->be->run(d->cfg.n, philosopher, d);
+}
+
+void dine_destroy(struct dine *d)
+{
+	for (int f = 0; f < d->cfg.n; f++)
+		d->be->lock_free(d->forks[f].lock);
+	for (int i = 0; i < d->cfg.n; i++)
+		d->be->parker_free(d->phil[i].parker);
+	d->be->lock_free(d->monitor);
+	free(d->forks);
+	free(d->phil);
+	free(d->wait);
+	free(d->wait_shared);
+	d->forks = NULL;
+	d->phil = NULL;
+	d->wait = NULL;
+	d->wait_shared = NULL;
+}
+
+void dine_snapshot(struct dine *d, int i, struct dine_view *v)
+{
+	struct dine_phil *p = &d->phil[i];
+	uint32_t seq;
+
+	for (;;)
+	{
+		seq = __atomic_load_n(&p->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+		{
+			d->be->delay(0);
+			continue;
+		}
+		v->state = __atomic_load_n(&p->state, __ATOMIC_RELAXED);
+		v->held = __atomic_load_n(&p->held, __ATOMIC_RELAXED);
+		v->meals = __atomic_load_n(&p->meals, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&p->seq, __ATOMIC_RELAXED) == seq)
+			return;
+	}
+}
+
+void dine_stats(struct dine *d, struct dine_stats *s)
+{
+	double sum = 0, sq = 0;
+
+	memset(s, 0, sizeof(*s));
+	s->meals_min = d->phil[0].meals;
+	for (int i = 0; i < d->cfg.n; i++)
+	{
+		struct dine_phil *p = &d->phil[i];
+
+		s->meals += p->meals;
+		if (p->meals < s->meals_min)
+			s->meals_min = p->meals;
+		if (p->meals > s->meals_max)
+			s->meals_max = p->meals;
+		if (p->starve_max > s->starve_max)
+			s->starve_max = p->starve_max;
+		sum += p->meals;
+		sq += (double)p->meals * p->meals;
+		if (d->wait)
+			hist_merge(&s->wait, &d->wait[i]);
+	}
+	if (d->wait_shared)
+		for (int k = 0; k < DINE_WAIT_SHARDS; k++)
+			hist_merge(&s->wait, &d->wait_shared[k]);
+	s->fairness = sq > 0? sum*sum / (d->cfg.n * sq) : 1;
+}
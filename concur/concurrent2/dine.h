@@ -0,0 +1,165 @@
+/*
+cs544 Concurrency 2 - dining philosophers engine
+
+N philosophers around a table with one fork (one lock) between every
+two neighbours. Philosopher i uses fork i on the left and fork (i+1)%N
+on the right. How a hungry philosopher gets both forks without deadlock
+is the strategy:
+
+  order    resource ordering, lower numbered fork first
+  waiter   Dijkstra's monitor: an arbitrator hands out both forks at
+           once, only when neither neighbour is eating
+  cm       Chandy-Misra: forks are owned, dirty after a meal, and a dirty
+           fork goes to the neighbour who asks for it
+  trylock  left fork, then try the right one; on failure put both down
+           and back off for a random, growing while
+
+The engine only talks to locks, threads and time through a backend, so
+the same strategies can run on something other than pthreads.
+*/
+#ifndef DINE_H
+#define DINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rt.h"
+
+#define CACHE_LINE 64
+
+// a wait histogram per philosopher is 4k; past this many philosophers
+// they share DINE_WAIT_SHARDS of them instead
+#define DINE_PHIL_HISTS 65536
+#define DINE_WAIT_SHARDS 64
+
+enum dine_strategy
+{
+	DINE_ORDER,
+	DINE_WAITER,
+	DINE_CM,
+	DINE_TRYLOCK,
+	DINE_STRATEGIES
+};
+
+// what a philosopher is doing
+enum dine_state
+{
+	DINE_THINKING,
+	DINE_HUNGRY,
+	DINE_EATING
+};
+
+// Locks are plain mutexes. park() blocks the calling philosopher until
+// somebody unpark()s it; an unpark that comes first is kept, so park()
+// then returns right away. run() starts fn(arg, i) for i in 0..n-1 and
+// returns when all of them have returned; it runs all of them or, -1,
+// none. delay(0) just lets somebody else run
+struct dine_backend
+{
+	const char *name;
+	void *(*lock_new)(void);
+	void (*lock_free)(void *l);
+	void (*lock)(void *l);
+	int (*trylock)(void *l);	// 1 if taken
+	void (*unlock)(void *l);
+	void *(*parker_new)(void);
+	void (*parker_free)(void *p);
+	void (*park)(void *p);
+	void (*unpark)(void *p);
+	void (*delay)(uint64_t ns);
+	uint64_t (*now)(void);
+	int (*run)(int n, void (*fn)(void *arg, int i), void *arg);
+};
+
+extern const struct dine_backend dine_pthreads;
+extern const struct dine_backend dine_coro;
+extern const struct dine_backend dine_sim;
+
+// coroutine backends: worker threads (0: one per cpu, sim always has
+// one), stack per philosopher (0: the default)
+void dine_coro_setup(int workers, size_t stack);
+
+struct dine_cfg
+{
+	int n;
+	int strategy;
+	uint64_t think_ns;	// think and eat times are uniform in [x/2, 3x/2]
+	uint64_t eat_ns;
+	uint64_t duration_ns;	// everybody leaves the table after this
+};
+
+struct dine_fork
+{
+	void *lock;
+	// Chandy-Misra: who has it, whether it's been eaten with, and the
+	// neighbour who asked for it (-1: nobody). Guarded by `lock`
+	int owner;
+	int dirty;
+	int req;
+	int in_use;
+} __attribute__((aligned(CACHE_LINE)));
+
+// state, held and meals are published under seq, see dine_snapshot()
+struct dine_phil
+{
+	uint32_t seq;
+	int state;	// enum dine_state
+	long meals;
+	uint64_t starve_max;	// longest stretch between two meals, ns
+	uint64_t wait_max;	// longest hungry to eating, ns
+	int held;	// forks in hand, for the status table
+	int wstate;	// waiter: the state the arbitrator goes by, under monitor
+	void *parker;
+} __attribute__((aligned(CACHE_LINE)));
+
+struct dine
+{
+	struct dine_cfg cfg;
+	const struct dine_backend *be;
+	struct dine_fork *forks;
+	struct dine_phil *phil;
+	struct hist *wait;	// per philosopher: hungry to eating, ns
+	struct hist *wait_shared;	// instead of that past DINE_PHIL_HISTS
+	void *monitor;	// waiter: the arbitrator's lock over everybody's state
+	int seated;	// philosophers at the table, the last one starts the clock
+	uint64_t start;
+	uint64_t end;
+};
+
+// -1 with errno set if N < 2 or out of memory
+int dine_init(struct dine *d, const struct dine_cfg *cfg, const struct dine_backend *be);
+// run until cfg.duration_ns has passed and everybody has left the table,
+// -1 if the backend couldn't seat everybody
+int dine_run(struct dine *d);
+void dine_destroy(struct dine *d);
+
+// one philosopher as a monitor sees it, all fields from the same moment
+struct dine_view
+{
+	int state;
+	int held;
+	long meals;
+};
+
+// safe while the table runs, doesn't slow the philosopher down
+void dine_snapshot(struct dine *d, int i, struct dine_view *v);
+
+// the whole table after a run
+struct dine_stats
+{
+	long meals;
+	long meals_min;
+	long meals_max;
+	// Jain's index over meals per philosopher: (sum x)^2 / (n sum x^2),
+	// 1 when everybody ate as often, 1/n when one philosopher ate alone
+	double fairness;
+	uint64_t starve_max;
+	struct hist wait;	// everybody's hungry to eating times
+};
+
+void dine_stats(struct dine *d, struct dine_stats *s);
+const char *dine_strategy_name(int strategy);
+// -1 if unknown
+int dine_strategy_parse(const char *name);
+
+#endif
@@ -0,0 +1,146 @@
+/*
+cs544 Concurrency 2 - coroutine backends for the dining philosophers
+
+Philosophers are coroutines on a few worker threads (coro.c). Waiting for
+a fork or for the waiter parks the coroutine, not the thread, so a table
+of a million fits in memory and switching between philosophers never
+goes through the kernel scheduler. The sim backend runs them on one
+thread against a virtual clock.
+*/
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "coro.h"
+#include "dine.h"
+#include "rt.h"
+
+static int workers;
+static size_t stack;
+
+void dine_coro_setup(int nworkers, size_t stack_bytes)
+{
+	workers = nworkers;
+	stack = stack_bytes;
+}
+
+static void *co_lock_new(void)
+{
+	struct coro_mutex *m = malloc(sizeof(*m));
+
+	if (m)
+		coro_mutex_init(m);
+	return m;
+}
+
+static void co_lock_free(void *l)
+{
+	free(l);
+}
+
+static void co_lock(void *l)
+{
+	coro_mutex_lock(l);
+}
+
+static int co_trylock(void *l)
+{
+	return coro_mutex_trylock(l);
+}
+
+static void co_unlock(void *l)
+{
+	coro_mutex_unlock(l);
+}
+
+static void *co_parker_new(void)
+{
+	struct coro_parker *p = malloc(sizeof(*p));
+
+	if (p)
+		coro_parker_init(p);
+	return p;
+}
+
+static void co_parker_free(void *p)
+{
+	free(p);
+}
+
+static void co_park(void *p)
+{
+	coro_park(p);
+}
+
+static void co_unpark(void *p)
+{
+	coro_unpark(p);
+}
+
+// the monitor thread isn't a coroutine, it gets the thread version
+static void co_delay(uint64_t ns)
+{
+	if (coro_self())
+	{
+		coro_sleep(ns);
+		return;
+	}
+	if (!ns)
+	{
+		sched_yield();
+		return;
+	}
+
+	struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+	while (nanosleep(&ts, &ts) && errno == EINTR)
+		;
+}
+
+static int co_run(int n, void (*fn)(void *arg, int i), void *arg)
+{
+	return coro_run(workers, n, stack, fn, arg);
+}
+
+static int sim_run(int n, void (*fn)(void *arg, int i), void *arg)
+{
+	return coro_run_sim(n, stack, fn, arg);
+}
+
+const struct dine_backend dine_coro =
+{
+	.name = "coro",
+	.lock_new = co_lock_new,
+	.lock_free = co_lock_free,
+	.lock = co_lock,
+	.trylock = co_trylock,
+	.unlock = co_unlock,
+	.parker_new = co_parker_new,
+	.parker_free = co_parker_free,
+	.park = co_park,
+	.unpark = co_unpark,
+	.delay = co_delay,
+	.now = now_ns,
+	.run = co_run,
+};
+
+// the same philosophers in a discrete-event simulation: thinking and
+// eating move a virtual clock instead of taking time
+const struct dine_backend dine_sim =
+{
+	.name = "sim",
+	.lock_new = co_lock_new,
+	.lock_free = co_lock_free,
+	.lock = co_lock,
+	.trylock = co_trylock,
+	.unlock = co_unlock,
+	.parker_new = co_parker_new,
+	.parker_free = co_parker_free,
+	.park = co_park,
+	.unpark = co_unpark,
+	.delay = co_delay,
+	.now = coro_now,
+	.run = sim_run,
+};
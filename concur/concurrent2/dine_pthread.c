@@ -0,0 +1,190 @@
+/*
+cs544 Concurrency 2 - pthread backend for the dining philosophers
+
+One thread per philosopher on a small stack, so a few thousand of them
+fit; mutexes for forks, a futex word for parking.
+*/
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "dine.h"
+#include "rt.h"
+
+// philosophers don't recurse, 64k is plenty and 4000 of them take 256MB
+// of address space instead of 32GB
+#define PHIL_STACK (64*1024)
+
+struct parker
+{
+	uint32_t permit;
+};
+
+// tasks wait for this before running, so run() can take them all back if
+// it can't start them all
+enum { GATE_WAIT, GATE_GO, GATE_ABORT };
+
+struct task
+{
+	void (*fn)(void *arg, int i);
+	void *arg;
+	int i;
+	uint32_t *gate;
+};
+
+static long futex(uint32_t *addr, int op, uint32_t val)
+{
+	return syscall(SYS_futex, addr, op, val, NULL, NULL, 0);
+}
+
+static void *pt_lock_new(void)
+{
+	pthread_mutex_t *m = malloc(sizeof(*m));
+
+	if (m)
+		pthread_mutex_init(m, NULL);
+	return m;
+}
+
+static void pt_lock_free(void *l)
+{
+	if (!l)
+		return;
+	pthread_mutex_destroy(l);
+	free(l);
+}
+
+static void pt_lock(void *l)
+{
+	pthread_mutex_lock(l);
+}
+
+static int pt_trylock(void *l)
+{
+	return pthread_mutex_trylock(l) == 0;
+}
+
+static void pt_unlock(void *l)
+{
+	pthread_mutex_unlock(l);
+}
+
+static void *pt_parker_new(void)
+{
+	return calloc(1, sizeof(struct parker));
+}
+
+static void pt_parker_free(void *p)
+{
+	free(p);
+}
+
+// take the permit, sleeping until there is one
+static void pt_park(void *arg)
+{
+	struct parker *p = arg;
+
+	while (!__atomic_exchange_n(&p->permit, 0, __ATOMIC_ACQUIRE))
+		futex(&p->permit, FUTEX_WAIT_PRIVATE, 0);
+}
+
+static void pt_unpark(void *arg)
+{
+	struct parker *p = arg;
+
+	if (!__atomic_exchange_n(&p->permit, 1, __ATOMIC_RELEASE))
+		futex(&p->permit, FUTEX_WAKE_PRIVATE, 1);
+}
+
+static void pt_delay(uint64_t ns)
+{
+	struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+
+	if (!ns)
+	{
+		sched_yield();
+		return;
+	}
+	while (nanosleep(&ts, &ts) && errno == EINTR)
+		;
+}
+
+static void *task_main(void *arg)
+{
+	struct task *t = arg;
+	uint32_t g;
+
+	while ((g = __atomic_load_n(t->gate, __ATOMIC_ACQUIRE)) == GATE_WAIT)
+		futex(t->gate, FUTEX_WAIT_PRIVATE, GATE_WAIT);
+	if (g == GATE_GO)
+		t->fn(t->arg, t->i);
+	return NULL;
+}
+
+static int pt_run(int n, void (*fn)(void *arg, int i), void *arg)
+{
+	pthread_t *threads = malloc(sizeof(pthread_t) * n);
+	struct task *tasks = malloc(sizeof(struct task) * n);
+	pthread_attr_t attr;
+	uint32_t gate = GATE_WAIT;
+	int started = 0;
+
+	if (!threads || !tasks)
+	{
+		free(threads);
+		free(tasks);
+		return -1;
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, PHIL_STACK < PTHREAD_STACK_MIN? PTHREAD_STACK_MIN : PHIL_STACK);
+
+	for (; started < n; started++)
+	{
+		tasks[started] = (struct task){ fn, arg, started, &gate };
+		int err = pthread_create(&threads[started], &attr, task_main, &tasks[started]);
+		if (err)
+		{
+			fprintf(stderr, "Error creating thread %d: %s\n", started, strerror(err));
+			break;
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	__atomic_store_n(&gate, started == n? GATE_GO : GATE_ABORT, __ATOMIC_RELEASE);
+	futex(&gate, FUTEX_WAKE_PRIVATE, INT_MAX);
+
+	for (int i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	free(tasks);
+	return started == n? 0 : -1;
+}
+
+const struct dine_backend dine_pthreads =
+{
+	.name = "pthread",
+	.lock_new = pt_lock_new,
+	.lock_free = pt_lock_free,
+	.lock = pt_lock,
+	.trylock = pt_trylock,
+	.unlock = pt_unlock,
+	.parker_new = pt_parker_new,
+	.parker_free = pt_parker_free,
+	.park = pt_park,
+	.unpark = pt_unpark,
+	.delay = pt_delay,
+	.now = now_ns,
+	.run = pt_run,
+};
@@ -0,0 +1,354 @@
+/*
+cs544 Concurrency 2 - reads the trace of a dining philosophers run
+
+dinetrace FILE puts the events of `concurrent2 -x FILE` back in time order
+and replays them: how long each philosopher thought, was hungry and ate,
+how much of the time each fork was in a hand, and whether anybody ever
+waited in a circle. A philosopher waits from the moment it reaches for a
+fork until it has it; a fork is held from the moment it's taken until
+it's put down, so a circle in who-waits-for-whom is a deadlock, not a
+near miss.
+*/
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dine.h"
+#include "trace.h"
+
+// philosophers of a cycle printed, at most
+#define CYCLE_SHOWN 16
+
+struct rec
+{
+	uint64_t t;
+	uint64_t seq;	// place in the file: a thread's own events stay in order
+	uint32_t who;
+	uint32_t what;
+};
+
+struct phil
+{
+	int state;	// -1 until its first event
+	uint64_t since;
+	uint64_t in[3];	// ns per enum dine_state
+	uint64_t hungry_max;
+	long meals;
+	int waiting;	// fork, or -1
+};
+
+struct fork
+{
+	int holder;	// philosopher, or -1
+	uint64_t since;
+	uint64_t busy;
+	uint64_t hold_max;
+	long uses;
+	long waits;
+};
+
+static struct trace_hdr hdr;
+static struct rec *ev;
+static size_t nev;
+static struct phil *phil;
+static struct fork *fork_;
+static long cycles, overlaps;
+
+static const char *state_name[] = { "thinking", "hungry", "eating" };
+static const char *type_name[] = { "state", "wait", "take", "put" };
+
+static int by_time(const void *a, const void *b)
+{
+	const struct rec *x = a, *y = b;
+
+	if (x->t != y->t)
+		return x->t < y->t? -1 : 1;
+	return x->seq < y->seq? -1 : x->seq > y->seq;
+}
+
+static void load(const char *path)
+{
+	FILE *in = fopen(path, "rb");
+	struct trace_ev e;
+	size_t cap = 0;
+
+	if (!in)
+	{
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	if (fread(&hdr, sizeof(hdr), 1, in) != 1 || hdr.magic != TRACE_MAGIC)
+	{
+		fprintf(stderr, "%s: not a trace\n", path);
+		exit(EXIT_FAILURE);
+	}
+	if (hdr.version != TRACE_VERSION || hdr.ev_size != sizeof(struct trace_ev))
+	{
+		fprintf(stderr, "%s: trace version %u, this reads %d\n", path, hdr.version, TRACE_VERSION);
+		exit(EXIT_FAILURE);
+	}
+	hdr.strategy[sizeof(hdr.strategy) - 1] = 0;
+	hdr.backend[sizeof(hdr.backend) - 1] = 0;
+
+	// a run that was killed leaves whole buffers, or part of the last one
+	while (fread(&e, sizeof(e), 1, in) == 1)
+	{
+		if (nev == cap)
+		{
+			cap = cap? cap*2 : 1 << 16;
+			if (!(ev = realloc(ev, cap*sizeof(*ev))))
+			{
+				perror("dinetrace");
+				exit(EXIT_FAILURE);
+			}
+		}
+		if (e.who >= hdr.philosophers || trace_ev_type(&e) > TRACE_REL)
+		{
+			fprintf(stderr, "%s: bad event %zu\n", path, nev);
+			exit(EXIT_FAILURE);
+		}
+		ev[nev].t = e.t;
+		ev[nev].seq = nev;
+		ev[nev].who = e.who;
+		ev[nev].what = e.what;
+		nev++;
+	}
+	fclose(in);
+	qsort(ev, nev, sizeof(*ev), by_time);
+}
+
+static uint64_t ns(uint64_t ticks)
+{
+	return ticks/hdr.ticks_per_ns;
+}
+
+// does p's wait close a circle? Everybody on it is waiting for a fork the
+// next one holds, and the last one for a fork p holds
+static void check_cycle(uint32_t p, uint64_t t)
+{
+	uint32_t q = p;
+
+	for (uint32_t steps = 0; steps < hdr.philosophers; steps++)
+	{
+		int f = phil[q].waiting;
+		if (f < 0 || fork_[f].holder < 0)
+			return;
+		q = fork_[f].holder;
+		if (q == p)
+			break;
+	}
+	if (q != p)
+		return;
+
+	cycles++;
+	printf("deadlock at %.6f s:", ns(t - ev[0].t)/1e9);
+	int shown = 0;
+	do
+	{
+		if (shown++ < CYCLE_SHOWN)
+			printf(" %u -(%d)->", q, phil[q].waiting);
+		q = fork_[phil[q].waiting].holder;
+	} while (q != p);
+	if (shown > CYCLE_SHOWN)
+		printf(" ... %d in all ->", shown);
+	printf(" %u\n", p);
+}
+
+static void replay(int timeline)
+{
+	uint64_t t0 = ev[0].t;
+
+	for (size_t k = 0; k < nev; k++)
+	{
+		struct rec *r = &ev[k];
+		struct trace_ev e = { r->t, r->who, r->what };
+		struct phil *p = &phil[r->who];
+		uint32_t arg = trace_ev_arg(&e);
+		int type = trace_ev_type(&e);
+
+		if (timeline)
+		{
+			printf("%.9f %u %s ", ns(r->t - t0)/1e9, r->who, type_name[type]);
+			if (type == TRACE_STATE)
+				printf("%s\n", arg < 3? state_name[arg] : "?");
+			else
+				printf("%u\n", arg);
+		}
+
+		if (type == TRACE_STATE)
+		{
+			if (arg > DINE_EATING)
+				continue;
+			if (p->state >= 0)
+			{
+				uint64_t d = ns(r->t - p->since);
+				p->in[p->state] += d;
+				if (p->state == DINE_HUNGRY && d > p->hungry_max)
+					p->hungry_max = d;
+			}
+			if (arg == DINE_EATING)
+				p->meals++;
+			p->state = arg;
+			p->since = r->t;
+			continue;
+		}
+
+		if (arg >= hdr.philosophers)
+			continue;
+		struct fork *f = &fork_[arg];
+
+		switch (type)
+		{
+			case TRACE_WAIT:
+				f->waits++;
+				p->waiting = arg;
+				check_cycle(r->who, r->t);
+				break;
+			case TRACE_ACQ:
+				if (f->holder >= 0 && f->holder != (int)r->who)
+				{
+					overlaps++;
+					printf("fork %u taken by %u at %.6f s while %d has it\n", arg, r->who,
+						ns(r->t - t0)/1e9, f->holder);
+				}
+				f->holder = r->who;
+				f->since = r->t;
+				f->uses++;
+				if (p->waiting == (int)arg)
+					p->waiting = -1;
+				break;
+			case TRACE_REL:
+				if (f->holder == (int)r->who)
+				{
+					uint64_t d = ns(r->t - f->since);
+					f->busy += d;
+					if (d > f->hold_max)
+						f->hold_max = d;
+				}
+				f->holder = -1;
+				break;
+		}
+	}
+
+	// close what's still open at the last event
+	uint64_t end = ev[nev - 1].t;
+	for (uint32_t i = 0; i < hdr.philosophers; i++)
+	{
+		if (phil[i].state >= 0)
+			phil[i].in[phil[i].state] += ns(end - phil[i].since);
+		if (fork_[i].holder >= 0)
+			fork_[i].busy += ns(end - fork_[i].since);
+	}
+}
+
+static void usage(char *name)
+{
+	printf("usage: %s [-p] [-f] [-l] FILE\n", name);
+	printf("  summary of a trace written by concurrent2 -x: time spent thinking, hungry and eating,\n");
+	printf("  how busy the forks were, and every deadlock (a circle of philosophers each waiting\n");
+	printf("  for a fork the next one holds)\n");
+	printf("  -p adds a CSV line per philosopher, -f one per fork, -l every event in time order\n");
+}
+
+int main(int argc, char **argv)
+{
+	int per_phil = 0, per_fork = 0, timeline = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "pfl")) != -1)
+	{
+		switch (opt)
+		{
+			case 'p': per_phil = 1; break;
+			case 'f': per_fork = 1; break;
+			case 'l': timeline = 1; break;
+			default:
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	load(argv[optind]);
+	if (!nev) {
+		fprintf(stderr, "%s: no events\n", argv[optind]);
+		exit(EXIT_FAILURE);
+	}
+
+	uint32_t n = hdr.philosophers;
+	phil = calloc(n, sizeof(*phil));
+	fork_ = calloc(n, sizeof(*fork_));
+	if (!phil || !fork_) {
+		perror("dinetrace");
+		exit(EXIT_FAILURE);
+	}
+	for (uint32_t i = 0; i < n; i++)
+	{
+		phil[i].state = -1;
+		phil[i].waiting = -1;
+		fork_[i].holder = -1;
+	}
+
+	replay(timeline);
+
+	uint64_t span = ns(ev[nev - 1].t - ev[0].t);
+	uint64_t in[3] = { 0, 0, 0 };
+	long meals = 0, uses = 0, waiting = 0;
+	double util_min = 1, util_max = 0, util_sum = 0;
+	uint32_t fork_min = 0, fork_max = 0;
+
+	for (uint32_t i = 0; i < n; i++)
+	{
+		for (int s = 0; s < 3; s++)
+			in[s] += phil[i].in[s];
+		meals += phil[i].meals;
+		waiting += phil[i].waiting >= 0;
+		uses += fork_[i].uses;
+
+		double u = span? (double)fork_[i].busy/span : 0;
+		util_sum += u;
+		if (u < util_min)
+			util_min = u, fork_min = i;
+		if (u > util_max)
+			util_max = u, fork_max = i;
+	}
+	uint64_t total = in[0] + in[1] + in[2];
+	if (!total)
+		total = 1;
+
+	printf("%s on %s, %u philosophers, %zu events over %.3f s\n", hdr.strategy, hdr.backend, n, nev, span/1e9);
+	printf("thinking %.1f%%, hungry %.1f%%, eating %.1f%%, %ld meals\n",
+		100.0*in[DINE_THINKING]/total, 100.0*in[DINE_HUNGRY]/total, 100.0*in[DINE_EATING]/total, meals);
+	printf("forks in use %.1f%% on average, least %.1f%% (fork %u), most %.1f%% (fork %u), taken %ld times\n",
+		100*util_sum/n, 100*util_min, fork_min, 100*util_max, fork_max, uses);
+	printf("deadlocks %ld, forks held twice %ld, waiting for a fork at the end %ld\n", cycles, overlaps, waiting);
+
+	if (per_phil)
+	{
+		printf("philosopher,meals,thinking_ns,hungry_ns,eating_ns,hungry_max_ns\n");
+		for (uint32_t i = 0; i < n; i++)
+			printf("%u,%ld,%llu,%llu,%llu,%llu\n", i, phil[i].meals,
+				(unsigned long long)phil[i].in[DINE_THINKING], (unsigned long long)phil[i].in[DINE_HUNGRY],
+				(unsigned long long)phil[i].in[DINE_EATING], (unsigned long long)phil[i].hungry_max);
+	}
+	if (per_fork)
+	{
+		printf("fork,taken,waits,busy_ns,utilisation,hold_max_ns\n");
+		for (uint32_t i = 0; i < n; i++)
+			printf("%u,%ld,%ld,%llu,%.4f,%llu\n", i, fork_[i].uses, fork_[i].waits,
+				(unsigned long long)fork_[i].busy, span? (double)fork_[i].busy/span : 0,
+				(unsigned long long)fork_[i].hold_max);
+	}
+
+	free(phil);
+	free(fork_);
+	free(ev);
+	return 0;
+}
@@ -0,0 +1,159 @@
+/*
+cs544 Concurrency 2 - binary trace of a dining philosophers run
+*/
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rt.h"
+#include "trace.h"
+
+// how long trace_open() watches the TSC against the clock
+#define TSC_CALIBRATE_NS 10000000
+
+struct tbuf
+{
+	struct tbuf *next;	// every buffer of this trace, for trace_close()
+	int n;
+	struct trace_ev ev[TRACE_CHUNK];
+};
+
+int trace_on;
+
+static int fd = -1;
+static uint64_t (*clock_fn)(void);
+static struct tbuf *all;
+static int write_errors;
+// which trace_open() this is: a thread that outlives a trace, like the
+// one sim runs on, mustn't keep the buffer trace_close() freed
+static unsigned trace_gen;
+
+static __thread struct tbuf *mine;
+static __thread unsigned mine_gen;
+
+// rdtscp waits for everything before it to be done, so an event isn't
+// stamped before the fork move it records; plain rdtsc can run ahead
+static inline uint64_t ticks(void)
+{
+	if (clock_fn)
+		return clock_fn();
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned aux;
+	return __builtin_ia32_rdtscp(&aux);
+#else
+	return now_ns();
+#endif
+}
+
+static double ticks_per_ns(void)
+{
+	if (clock_fn)
+		return 1;
+#if defined(__x86_64__) || defined(__i386__)
+	uint64_t t0 = now_ns(), c0 = ticks();
+	uint64_t t1, c1;
+
+	while ((t1 = now_ns()) - t0 < TSC_CALIBRATE_NS)
+		;
+	c1 = ticks();
+	return (double)(c1 - c0) / (t1 - t0);
+#else
+	return 1;
+#endif
+}
+
+int trace_open(const char *path, int philosophers, const char *strategy, const char *backend,
+	uint64_t (*clock)(void))
+{
+	struct trace_hdr h;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	if (fd < 0)
+		return -1;
+
+	clock_fn = clock;
+	memset(&h, 0, sizeof(h));
+	h.magic = TRACE_MAGIC;
+	h.version = TRACE_VERSION;
+	h.philosophers = philosophers;
+	h.ev_size = sizeof(struct trace_ev);
+	h.ticks_per_ns = ticks_per_ns();
+	h.t0 = ticks();
+	strncpy(h.strategy, strategy, sizeof(h.strategy) - 1);
+	strncpy(h.backend, backend, sizeof(h.backend) - 1);
+	if (write(fd, &h, sizeof(h)) != sizeof(h))
+	{
+		int err = errno;
+		close(fd);
+		fd = -1;
+		errno = err;
+		return -1;
+	}
+
+	write_errors = 0;
+	trace_gen++;
+	trace_on = 1;
+	return 0;
+}
+
+static void flush(struct tbuf *b)
+{
+	size_t len = sizeof(struct trace_ev) * b->n;
+
+	if (b->n && write(fd, b->ev, len) != (ssize_t)len)
+		__atomic_add_fetch(&write_errors, 1, __ATOMIC_RELAXED);
+	b->n = 0;
+}
+
+void trace_add(uint32_t who, int type, uint32_t arg)
+{
+	struct tbuf *b = mine;
+
+	if (!b || mine_gen != trace_gen)
+	{
+		if (!(b = malloc(sizeof(*b))))
+			return;
+		b->n = 0;
+		b->next = __atomic_load_n(&all, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&all, &b->next, b, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			;
+		mine = b;
+		mine_gen = trace_gen;
+	}
+
+	struct trace_ev *e = &b->ev[b->n++];
+	e->t = ticks();
+	e->who = who;
+	e->what = (uint32_t)type << TRACE_ARG_BITS | (arg & TRACE_ARG_MASK);
+
+	if (b->n == TRACE_CHUNK)
+		flush(b);
+}
+
+int trace_close(void)
+{
+	struct tbuf *b = __atomic_exchange_n(&all, NULL, __ATOMIC_ACQUIRE);
+
+	trace_on = 0;
+	while (b)
+	{
+		struct tbuf *next = b->next;
+		flush(b);
+		free(b);
+		b = next;
+	}
+
+	int err = close(fd);
+	fd = -1;
+	if (write_errors)
+	{
+		fprintf(stderr, "trace: %d buffers could not be written\n", write_errors);
+		return -1;
+	}
+	return err;
+}
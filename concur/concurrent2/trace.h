@@ -0,0 +1,81 @@
+/*
+cs544 Concurrency 2 - binary trace of a dining philosophers run
+
+Every thread records events into a buffer of its own, no locks and no
+shared counters; a full buffer goes to the file with one write() on an
+O_APPEND descriptor, so buffers from different threads never interleave
+inside. Timestamps are TSC ticks (the simulation's clock in sim runs),
+the header says how many make a nanosecond. Records are in no particular
+order across threads, dinetrace sorts them.
+
+File: struct trace_hdr, then struct trace_ev records to the end.
+*/
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_MAGIC 0x43525444u	// "DTRC"
+#define TRACE_VERSION 1
+
+// events per thread buffer
+#define TRACE_CHUNK 512
+
+enum trace_type
+{
+	TRACE_STATE,	// arg: enum dine_state the philosopher is now in
+	TRACE_WAIT,	// arg: fork it's about to wait for
+	TRACE_ACQ,	// arg: fork it now holds
+	TRACE_REL	// arg: fork it lets go of
+};
+
+struct trace_hdr
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t philosophers;
+	uint32_t ev_size;
+	double ticks_per_ns;
+	uint64_t t0;	// ticks when the trace was opened
+	char strategy[16];
+	char backend[16];
+};
+
+// type in the top 4 bits of `what`, the argument in the rest
+#define TRACE_ARG_BITS 28
+#define TRACE_ARG_MASK ((1u << TRACE_ARG_BITS) - 1)
+
+struct trace_ev
+{
+	uint64_t t;
+	uint32_t who;	// philosopher
+	uint32_t what;
+};
+
+static inline int trace_ev_type(const struct trace_ev *e)
+{
+	return e->what >> TRACE_ARG_BITS;
+}
+
+static inline uint32_t trace_ev_arg(const struct trace_ev *e)
+{
+	return e->what & TRACE_ARG_MASK;
+}
+
+extern int trace_on;
+
+// -1 with errno set if the file can't be made. `clock` NULL is the TSC
+int trace_open(const char *path, int philosophers, const char *strategy, const char *backend,
+	uint64_t (*clock)(void));
+void trace_add(uint32_t who, int type, uint32_t arg);
+// writes out what's left in every buffer. The threads that traced must
+// be gone, their buffers go with this
+int trace_close(void);
+
+static inline void trace(uint32_t who, int type, uint32_t arg)
+{
+	if (trace_on)
+		trace_add(who, type, arg);
+}
+
+#endif
@@ -0,0 +1,323 @@
+/*
+cs544 Concurrency 3 - turkey dinners in a concurrent skip list
+*/
+#include <sched.h>
+#include <stddef.h>
+
+#include "dinners.h"
+#include "pool.h"
+#include "rt.h"
+
+// waiting for a dinner's lock: this many pauses, then sched_yield() until
+// whoever has it gets to run
+#define DINNER_SPINS 64
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+
+// every link a search follows is read with acquire, and written with
+// release once the dinner it points to is all set up
+static inline struct TurkeyDinner *next_of(struct TurkeyDinner *d, int level)
+{
+	return __atomic_load_n(&d->next_dinner[level], __ATOMIC_ACQUIRE);
+}
+
+static inline void set_next(struct TurkeyDinner *d, int level, struct TurkeyDinner *to)
+{
+	__atomic_store_n(&d->next_dinner[level], to, __ATOMIC_RELEASE);
+}
+
+static inline int is_marked(struct TurkeyDinner *d)
+{
+	return __atomic_load_n(&d->marked, __ATOMIC_ACQUIRE);
+}
+
+static inline int is_linked(struct TurkeyDinner *d)
+{
+	return __atomic_load_n(&d->fully_linked, __ATOMIC_ACQUIRE);
+}
+
+static void lock_dinner(struct TurkeyDinner *d)
+{
+	int spins = 0;
+
+	while (__atomic_exchange_n(&d->lock, 1, __ATOMIC_ACQUIRE))
+		while (__atomic_load_n(&d->lock, __ATOMIC_RELAXED))
+		{
+			if (++spins < DINNER_SPINS)
+				cpu_relax();
+			else
+				sched_yield();
+		}
+}
+
+static void unlock_dinner(struct TurkeyDinner *d)
+{
+	__atomic_store_n(&d->lock, 0, __ATOMIC_RELEASE);
+}
+
+static struct TurkeyDinner *alloc_dinner(int top)
+{
+	struct TurkeyDinner *d = pool_alloc(sizeof(*d) + (top + 1)*sizeof(d->next_dinner[0]));
+
+	if (!d)
+		return NULL;
+	d->id = 0;
+	d->number_guests = 0;
+	d->lock = 0;
+	d->top = top;
+	d->marked = 0;
+	d->fully_linked = 0;
+	for (int l = 0; l <= top; l++)
+		d->next_dinner[l] = NULL;
+	return d;
+}
+
+// the last epoch that could see it is over: back to the pool of the
+// thread that made it, from whichever thread this is
+static void reclaim(struct epoch_entry *e)
+{
+	pool_free((char *)e - offsetof(struct TurkeyDinner, retired));
+}
+
+int dinners_init(struct dinners *list)
+{
+	epoch_init(reclaim);
+	list->last_id = 0;
+	list->count = 0;
+	if (rank_init(&list->order))
+		return -1;
+	if (!(list->head = alloc_dinner(DINNER_LEVELS - 1)))
+		return -1;
+	list->head->fully_linked = 1;
+	return 0;
+}
+
+// level l with probability 1/2^(l+1)
+static int random_top(void)
+{
+	return __builtin_ctz(rt_rand() | 1u << (DINNER_LEVELS - 1));
+}
+
+struct TurkeyDinner *dinner_new(int number_guests)
+{
+	struct TurkeyDinner *d = alloc_dinner(random_top());
+
+	if (d)
+		d->number_guests = number_guests;
+	return d;
+}
+
+// the last dinner before `id` and the first from it on, on every level.
+// Returns the highest level dinner `id` itself is on, -1 if it isn't
+static int find(struct dinners *list, int id, struct TurkeyDinner **preds, struct TurkeyDinner **succs)
+{
+	struct TurkeyDinner *pred = list->head;
+	int found = -1;
+
+	for (int l = DINNER_LEVELS - 1; l >= 0; l--)
+	{
+		struct TurkeyDinner *curr = next_of(pred, l);
+		while (curr && curr->id < id)
+		{
+			pred = curr;
+			curr = next_of(pred, l);
+		}
+		if (found < 0 && curr && curr->id == id)
+			found = l;
+		preds[l] = pred;
+		succs[l] = curr;
+	}
+	return found;
+}
+
+// a dinner can be the predecessor on several levels in a row, and is
+// only locked once
+static void unlock_preds(struct TurkeyDinner **preds, int highest)
+{
+	for (int l = 0; l <= highest; l++)
+		if (!l || preds[l] != preds[l - 1])
+			unlock_dinner(preds[l]);
+}
+
+// lock the predecessors from the bottom up and check that nothing moved
+// since find(): they're still in the list and still point at succs.
+// Locks always go from later dinners to earlier ones, so two threads
+// can't wait on each other. `highest` is the last level locked
+static int lock_preds(struct TurkeyDinner **preds, struct TurkeyDinner **succs, int top, int inserting,
+	int *highest)
+{
+	int valid = 1;
+
+	*highest = -1;
+	for (int l = 0; valid && l <= top; l++)
+	{
+		struct TurkeyDinner *pred = preds[l], *succ = succs[l];
+
+		if (!l || pred != preds[l - 1])
+			lock_dinner(pred);
+		*highest = l;
+		valid = !is_marked(pred) && next_of(pred, l) == succ;
+		if (inserting && succ)
+			valid = valid && !is_marked(succ);
+	}
+	return valid;
+}
+
+int dinners_add(struct dinners *list, struct TurkeyDinner *d)
+{
+	struct TurkeyDinner *preds[DINNER_LEVELS], *succs[DINNER_LEVELS];
+	int highest;
+	// once it's in, it can be cancelled and gone before we're back
+	int id = d->id = __atomic_add_fetch(&list->last_id, 1, __ATOMIC_RELAXED);
+
+	// counted before it's linked, so it can't be cancelled, and taken out
+	// of the counts, before it's in them
+	if (rank_add(&list->order, id))
+		return 0;
+	epoch_enter();
+	for (;;)
+	{
+		find(list, id, preds, succs);
+		if (!lock_preds(preds, succs, d->top, 1, &highest))
+		{
+			unlock_preds(preds, highest);
+			continue;
+		}
+
+		for (int l = 0; l <= d->top; l++)
+			d->next_dinner[l] = succs[l];
+		for (int l = 0; l <= d->top; l++)
+			set_next(preds[l], l, d);
+		__atomic_store_n(&d->fully_linked, 1, __ATOMIC_RELEASE);
+		unlock_preds(preds, highest);
+		epoch_exit();
+
+		__atomic_add_fetch(&list->count, 1, __ATOMIC_RELAXED);
+		return id;
+	}
+}
+
+// cancel dinner `id`: NULL if it isn't there or somebody else got to it.
+// Inside an epoch
+static struct TurkeyDinner *cancel(struct dinners *list, int id)
+{
+	struct TurkeyDinner *preds[DINNER_LEVELS], *succs[DINNER_LEVELS];
+	struct TurkeyDinner *victim = NULL;
+	int highest;
+
+	for (;;)
+	{
+		int found = find(list, id, preds, succs);
+
+		if (!victim)
+		{
+			// only a dinner found on its top level is all the way in
+			if (found < 0)
+				return NULL;
+			victim = succs[found];
+			if (!is_linked(victim) || victim->top != found || is_marked(victim))
+				return NULL;
+
+			lock_dinner(victim);
+			if (victim->marked)
+			{
+				unlock_dinner(victim);
+				return NULL;
+			}
+			// from here on it's ours, and gone for everybody else
+			__atomic_store_n(&victim->marked, 1, __ATOMIC_RELEASE);
+		}
+
+		if (!lock_preds(preds, succs, victim->top, 0, &highest))
+		{
+			unlock_preds(preds, highest);
+			continue;
+		}
+
+		for (int l = victim->top; l >= 0; l--)
+			set_next(preds[l], l, victim->next_dinner[l]);
+		unlock_dinner(victim);
+		unlock_preds(preds, highest);
+
+		// uncounted before it leaves the tree, the other way round from
+		// dinners_add(): a position under the count is always in the tree
+		__atomic_sub_fetch(&list->count, 1, __ATOMIC_RELAXED);
+		rank_remove(&list->order, id);
+		return victim;
+	}
+}
+
+// first dinner from `id` on that isn't being cancelled, NULL if none.
+// Inside an epoch
+static struct TurkeyDinner *first_from(struct dinners *list, int id)
+{
+	struct TurkeyDinner *preds[DINNER_LEVELS], *succs[DINNER_LEVELS];
+	struct TurkeyDinner *d;
+
+	find(list, id, preds, succs);
+	for (d = succs[0]; d; d = next_of(d, 0))
+		if (is_linked(d) && !is_marked(d))
+			break;
+	return d;
+}
+
+// cancel the first dinner from `id` on, or from the start if there are
+// none after. Returns its id, 0 if the list was empty
+static int cancel_from(struct dinners *list, int id)
+{
+	int wrapped = 0;
+
+	epoch_enter();
+	for (;;)
+	{
+		struct TurkeyDinner *d = first_from(list, id);
+
+		if (!d)
+		{
+			if (wrapped || !dinners_count(list))
+				break;
+			wrapped = 1;
+			id = 1;
+			continue;
+		}
+		// lost it to another deleter, try the one after
+		int next = d->id + 1;
+		if ((d = cancel(list, d->id)))
+		{
+			id = d->id;
+			epoch_exit();
+			epoch_retire(&d->retired);
+			return id;
+		}
+		id = next;
+	}
+	epoch_exit();
+	return 0;
+}
+
+// an id just counted may not be linked yet, and one just cancelled may
+// still be in the tree: both go on to the next dinner that's really there.
+// 0 only if everything from there on was cancelled meanwhile
+int dinners_find_nth(struct dinners *list, int index)
+{
+	int id = rank_select(&list->order, index);
+
+	if (!id)
+		return 0;
+	epoch_enter();
+	struct TurkeyDinner *d = first_from(list, id);
+	id = d? d->id : 0;
+	epoch_exit();
+	return id;
+}
+
+int dinners_cancel_nth(struct dinners *list, int index)
+{
+	int id = rank_select(&list->order, index);
+
+	return id? cancel_from(list, id) : 0;
+}
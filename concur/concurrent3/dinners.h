@@ -0,0 +1,83 @@
+/*
+cs544 Concurrency 3 - turkey dinners in a concurrent skip list
+
+Dinners are kept in id order in a lazy skip list (Herlihy, Lev, Luchangco
+and Shavit): finding one takes no lock at all, adding or cancelling one
+locks only the dinners right before it on each level, so searches,
+inserts and deletes in different parts of the list go on side by side.
+A cancelled dinner is marked first, which takes it out of the list as
+far as everybody is concerned, then unlinked level by level.
+
+Unlinked dinners can still be in the hands of a search that started
+before, they're freed through epoch.h once none can be. Nothing on the
+list waits for that, searchers don't even know about it.
+
+Dinners are also counted by position (rank.h), so the nth dinner is a
+walk down a tree and not along the list.
+
+Dinners come from the pools of pool.h. The lock is a spinlock of 4
+bytes, as it's held for a few stores at most, so a dinner on up to 5
+levels, 31 in 32 of them, is one cache line.
+*/
+#ifndef DINNERS_H
+#define DINNERS_H
+
+#include <stdint.h>
+
+#include "epoch.h"
+#include "rank.h"
+
+// levels of the skip list, enough for 2^16 dinners in O(log n)
+#define DINNER_LEVELS 16
+
+// In honor of Thanksgiving, Turkey dinner nodes for our skip list
+struct TurkeyDinner
+{
+	int id;
+	int number_guests;  // number of turkeys
+	uint32_t lock;	// held to change next_dinner or marked
+	uint8_t top;	// highest level it's linked on
+	uint8_t marked;	// cancelled, whatever the links say
+	uint8_t fully_linked;	// linked on every level up to top
+	struct epoch_entry retired;	// waiting to be freed, after unlinking
+	struct TurkeyDinner *next_dinner[];	// one per level up to top, NULL at the end
+};
+
+struct dinners
+{
+	struct TurkeyDinner *head;	// id 0, on every level
+	int last_id;	// ids are handed out 1, 2, 3...
+	int count;
+	struct rank order;	// where each id is in the list
+};
+
+// -1 if out of memory. There's one list, it sets up epoch.h for its own
+int dinners_init(struct dinners *list);
+
+// a dinner with room for a random number of levels, not in the list yet
+struct TurkeyDinner *dinner_new(int number_guests);
+
+// gives d the next id and puts it at the end of the list, returns the
+// id; 0 if out of memory, d is still ours then
+int dinners_add(struct dinners *list, struct TurkeyDinner *d);
+
+// Positions count from 1. With inserts and deletes going on they're only
+// as exact as anybody could tell: it's the dinner that was about there
+
+// id of the index-th dinner, 0 if there aren't that many
+int dinners_find_nth(struct dinners *list, int index);
+
+// cancel the index-th dinner, returns its id; 0 if the list was empty
+int dinners_cancel_nth(struct dinners *list, int index);
+
+static inline int dinners_count(struct dinners *list)
+{
+	return __atomic_load_n(&list->count, __ATOMIC_RELAXED);
+}
+
+static inline int dinners_last_id(struct dinners *list)
+{
+	return __atomic_load_n(&list->last_id, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -0,0 +1,146 @@
+/*
+cs544 Concurrency 3 - epoch based reclamation
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "epoch.h"
+
+#define CACHE_LINE 64
+
+// a thread tries to move the epoch on, and frees what it can, every
+// this many retires
+#define EPOCH_BATCH 64
+
+// nodes wait in one of 3 bags per thread: the one of the current epoch,
+// the previous one (still maybe seen) and the one before (free)
+#define EPOCH_BAGS 3
+
+struct bag
+{
+	uint64_t epoch;
+	struct epoch_entry *head;
+};
+
+// one per thread that ever entered, never freed: threads come and go
+// rarely enough here that keeping them beats a way to take them out
+struct epoch_rec
+{
+	uint64_t state __attribute__((aligned(CACHE_LINE)));	// epoch << 1 | 1 while inside, 0 outside
+	struct epoch_rec *next;
+	struct bag bags[EPOCH_BAGS];
+	int retired;	// since the last try to move on
+};
+
+static uint64_t global_epoch __attribute__((aligned(CACHE_LINE))) = 2;
+static struct epoch_rec *recs;
+static void (*reclaim_fn)(struct epoch_entry *e);
+
+static __thread struct epoch_rec *mine;
+
+void epoch_init(void (*reclaim)(struct epoch_entry *e))
+{
+	reclaim_fn = reclaim;
+}
+
+static struct epoch_rec *rec(void)
+{
+	struct epoch_rec *r = mine;
+
+	if (r)
+		return r;
+	if (posix_memalign((void **)&r, CACHE_LINE, sizeof(*r)))
+	{
+		fprintf(stderr, "epoch: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	r->state = 0;
+	r->retired = 0;
+	for (int i = 0; i < EPOCH_BAGS; i++)
+	{
+		r->bags[i].epoch = 0;
+		r->bags[i].head = NULL;
+	}
+	r->next = __atomic_load_n(&recs, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&recs, &r->next, r, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+	return mine = r;
+}
+
+void epoch_enter(void)
+{
+	struct epoch_rec *r = rec();
+	uint64_t e;
+
+	// the epoch we say we're in has to still be the global one after
+	// everybody can see we're in, or it could already have moved past us
+	do
+	{
+		e = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&r->state, e << 1 | 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	} while (__atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST) != e);
+}
+
+void epoch_exit(void)
+{
+	__atomic_store_n(&mine->state, 0, __ATOMIC_RELEASE);
+}
+
+// move the epoch on if everybody inside is on it already
+static void try_advance(void)
+{
+	uint64_t e = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for (struct epoch_rec *r = __atomic_load_n(&recs, __ATOMIC_ACQUIRE); r; r = r->next)
+	{
+		uint64_t s = __atomic_load_n(&r->state, __ATOMIC_ACQUIRE);
+		if ((s & 1) && s >> 1 != e)
+			return;
+	}
+	__atomic_compare_exchange_n(&global_epoch, &e, e + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static void free_bag(struct bag *b)
+{
+	struct epoch_entry *e = b->head;
+
+	while (e)
+	{
+		struct epoch_entry *next = e->next;
+		reclaim_fn(e);
+		e = next;
+	}
+	b->head = NULL;
+}
+
+void epoch_retire(struct epoch_entry *e)
+{
+	struct epoch_rec *r = rec();
+
+	// whoever could reach it was inside by the epoch read after it was
+	// taken out, the fence keeps the read after the unlinking
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	uint64_t now = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+	struct bag *b = &r->bags[now % EPOCH_BAGS];
+
+	// left over from 3 or more epochs ago
+	if (b->epoch != now)
+	{
+		free_bag(b);
+		b->epoch = now;
+	}
+	e->next = b->head;
+	b->head = e;
+
+	if (++r->retired < EPOCH_BATCH)
+		return;
+	r->retired = 0;
+	try_advance();
+	now = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+	for (int i = 0; i < EPOCH_BAGS; i++)
+		if (r->bags[i].head && r->bags[i].epoch + 2 <= now)
+			free_bag(&r->bags[i]);
+}
@@ -0,0 +1,34 @@
+/*
+cs544 Concurrency 3 - epoch based reclamation
+
+Threads that read shared nodes without a lock wrap the reading in
+epoch_enter()/epoch_exit(). A node taken out of the structure goes to
+epoch_retire() instead of free(): it's tagged with the global epoch and
+freed once that epoch is two behind, by which time every thread that
+could have been looking at it has left. The global epoch moves on when
+every thread inside is on the current one; nobody ever waits for it.
+
+Entering and leaving write only the thread's own record, so readers
+don't fight over a lock's cache line the way they do on a rwlock.
+*/
+#ifndef EPOCH_H
+#define EPOCH_H
+
+// link in a retired node, put it anywhere in the node
+struct epoch_entry
+{
+	struct epoch_entry *next;
+};
+
+// how retired nodes get freed, given their epoch_entry. Call once before
+// anything else
+void epoch_init(void (*reclaim)(struct epoch_entry *e));
+
+// no nesting
+void epoch_enter(void);
+void epoch_exit(void);
+
+// the node isn't reachable for anybody who enters from now on
+void epoch_retire(struct epoch_entry *e);
+
+#endif
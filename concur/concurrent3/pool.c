@@ -0,0 +1,114 @@
+/*
+cs544 Concurrency 3 - per-thread pools of cache-line sized blocks
+*/
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+// slabs are aligned to their size, so a block finds its slab with a mask
+#define POOL_SLAB (64*1024)
+
+struct block
+{
+	struct block *next;
+};
+
+struct pool
+{
+	struct block *free[POOL_CLASSES];	// owner only
+	char *bump[POOL_CLASSES];	// rest of the slab being carved, owner only
+	char *end[POOL_CLASSES];
+	// freed by other threads, on a line of its own as they all write it
+	struct block *remote[POOL_CLASSES] __attribute__((aligned(CACHE_LINE)));
+};
+
+// first line of every slab: whose blocks they are, and what size
+struct slab
+{
+	struct pool *owner;
+	int class;
+};
+
+// never freed: blocks of a thread that's gone can still be out there
+static __thread struct pool *mine;
+
+static struct pool *pool(void)
+{
+	struct pool *p = mine;
+
+	if (p)
+		return p;
+	if (posix_memalign((void **)&p, CACHE_LINE, sizeof(*p)))
+		return NULL;
+	for (int c = 0; c < POOL_CLASSES; c++)
+	{
+		p->free[c] = p->remote[c] = NULL;
+		p->bump[c] = p->end[c] = NULL;
+	}
+	return mine = p;
+}
+
+// a new slab for class c
+static int grow(struct pool *p, int c)
+{
+	struct slab *s;
+
+	if (posix_memalign((void **)&s, POOL_SLAB, POOL_SLAB))
+		return -1;
+	s->owner = p;
+	s->class = c;
+	p->bump[c] = (char *)s + CACHE_LINE;
+	p->end[c] = (char *)s + POOL_SLAB;
+	return 0;
+}
+
+void *pool_alloc(size_t size)
+{
+	struct pool *p = pool();
+	int c = (int)((size + CACHE_LINE - 1)/CACHE_LINE) - 1;
+	struct block *b;
+
+	if (!p || c < 0 || c >= POOL_CLASSES)
+		return NULL;
+
+	if ((b = p->free[c]))
+	{
+		p->free[c] = b->next;
+		return b;
+	}
+	// what the others gave back, all of it at once: nobody else takes
+	// from there, so the list can't change under us once it's ours
+	if (__atomic_load_n(&p->remote[c], __ATOMIC_RELAXED) &&
+		(b = __atomic_exchange_n(&p->remote[c], NULL, __ATOMIC_ACQUIRE)))
+	{
+		p->free[c] = b->next;
+		return b;
+	}
+
+	size_t bytes = (size_t)(c + 1)*CACHE_LINE;
+	if ((size_t)(p->end[c] - p->bump[c]) < bytes && grow(p, c))
+		return NULL;
+	b = (struct block *)p->bump[c];
+	p->bump[c] += bytes;
+	return b;
+}
+
+void pool_free(void *ptr)
+{
+	struct slab *s = (struct slab *)((uintptr_t)ptr & ~(uintptr_t)(POOL_SLAB - 1));
+	struct pool *owner = s->owner;
+	struct block *b = ptr;
+	int c = s->class;
+
+	if (owner == mine)
+	{
+		b->next = owner->free[c];
+		owner->free[c] = b;
+		return;
+	}
+
+	b->next = __atomic_load_n(&owner->remote[c], __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&owner->remote[c], &b->next, b, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+}
@@ -0,0 +1,29 @@
+/*
+cs544 Concurrency 3 - per-thread pools of cache-line sized blocks
+
+Every thread carves blocks of 1 to POOL_CLASSES cache lines out of slabs
+of its own, and keeps the ones freed back to it on a list per size: no
+locks, no malloc() on the way, and a block that's just been freed is
+handed out again while it's still in the cache. Blocks start on a cache
+line, so one that fits in a line takes exactly one.
+
+Any thread can free any block. The slab it's in says whose it is; a
+block of somebody else's goes on that thread's remote list, a stack the
+others push on and only the owner takes from, all of it at once, when
+its own list runs dry.
+*/
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+#define CACHE_LINE 64
+
+// largest block, in cache lines
+#define POOL_CLASSES 4
+
+// NULL if out of memory or bigger than POOL_CLASSES lines
+void *pool_alloc(size_t size);
+void pool_free(void *p);
+
+#endif
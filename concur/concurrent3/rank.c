@@ -0,0 +1,130 @@
+/*
+cs544 Concurrency 3 - which dinner is the nth one
+*/
+#include <stdlib.h>
+
+#include "rank.h"
+
+// the child of id at `level`, 0 is the root
+static inline int slot_of(int id, int level)
+{
+	return ((uint64_t)id >> (RANK_BITS*(RANK_DEPTH - level))) & (RANK_WAYS - 1);
+}
+
+int rank_init(struct rank *r)
+{
+	return (r->root = calloc(1, sizeof(*r->root)))? 0 : -1;
+}
+
+// somebody else may be putting the same child in, the first one wins
+static struct rank_node *child(struct rank_node *n, int slot)
+{
+	struct rank_node *c = __atomic_load_n(&n->child[slot], __ATOMIC_ACQUIRE);
+	struct rank_node *mine;
+
+	if (c)
+		return c;
+	if (!(mine = calloc(1, sizeof(*mine))))
+		return NULL;
+	if (__atomic_compare_exchange_n(&n->child[slot], &c, mine, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		return mine;
+	free(mine);
+	return c;
+}
+
+int rank_add(struct rank *r, int id)
+{
+	struct rank_node *n = r->root;
+	int level, slot;
+
+	// every node on the way is there before the counts say so, so going
+	// down by the counts never runs into a missing child
+	for (level = 0; level < RANK_DEPTH - 1; level++)
+		if (!(n = child(n, slot_of(id, level))))
+			return -1;
+
+	n = r->root;
+	for (level = 0; level < RANK_DEPTH - 1; level++)
+	{
+		slot = slot_of(id, level);
+		__atomic_add_fetch(&n->count[slot], 1, __ATOMIC_RELEASE);
+		n = __atomic_load_n(&n->child[slot], __ATOMIC_ACQUIRE);
+	}
+	slot = slot_of(id, level);
+	__atomic_or_fetch(&n->bits[slot], 1ull << (id & (RANK_WAYS - 1)), __ATOMIC_RELEASE);
+	__atomic_add_fetch(&n->count[slot], 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void rank_remove(struct rank *r, int id)
+{
+	struct rank_node *n = r->root;
+	int level, slot;
+
+	for (level = 0; level < RANK_DEPTH - 1; level++)
+	{
+		slot = slot_of(id, level);
+		__atomic_sub_fetch(&n->count[slot], 1, __ATOMIC_RELEASE);
+		n = __atomic_load_n(&n->child[slot], __ATOMIC_ACQUIRE);
+	}
+	slot = slot_of(id, level);
+	__atomic_and_fetch(&n->bits[slot], ~(1ull << (id & (RANK_WAYS - 1))), __ATOMIC_RELEASE);
+	__atomic_sub_fetch(&n->count[slot], 1, __ATOMIC_RELEASE);
+}
+
+// the child the k-th id (from 0) under n is in, k left as its place in
+// there; -1 if there aren't that many. Below the root, counts moving
+// under us can make k run past the end, then it's the last id in the
+// last child that has any
+static int pick(struct rank_node *n, uint32_t *k, int clamp)
+{
+	int last = -1;
+	uint32_t last_count = 0;
+
+	for (int slot = 0; slot < RANK_WAYS; slot++)
+	{
+		uint32_t c = __atomic_load_n(&n->count[slot], __ATOMIC_ACQUIRE);
+		if (!c)
+			continue;
+		if (*k < c)
+			return slot;
+		*k -= c;
+		last = slot;
+		last_count = c;
+	}
+	if (!clamp)
+		return -1;
+	if (last >= 0)
+		*k = last_count - 1;
+	return last;
+}
+
+int rank_select(struct rank *r, int index)
+{
+	struct rank_node *n = r->root;
+	uint32_t k = index - 1;
+	uint64_t id = 0;
+	int level, slot;
+
+	if (index < 1)
+		return 0;
+	for (level = 0; level < RANK_DEPTH - 1; level++)
+	{
+		if ((slot = pick(n, &k, level > 0)) < 0)
+			return 0;
+		id = id << RANK_BITS | slot;
+		n = __atomic_load_n(&n->child[slot], __ATOMIC_ACQUIRE);
+	}
+	if ((slot = pick(n, &k, 1)) < 0)
+		return 0;
+
+	uint64_t w = __atomic_load_n(&n->bits[slot], __ATOMIC_ACQUIRE);
+	if (!w)
+		return 0;
+	if (k >= (uint32_t)__builtin_popcountll(w))
+		k = __builtin_popcountll(w) - 1;
+	while (k--)
+		w &= w - 1;
+	id = (id << RANK_BITS | slot) << RANK_BITS | __builtin_ctzll(w);
+	return id;
+}
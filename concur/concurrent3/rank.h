@@ -0,0 +1,51 @@
+/*
+cs544 Concurrency 3 - which dinner is the nth one
+
+A counted tree over dinner ids: 64 ways at every level, a bit per id at
+the bottom, and next to every child the number of ids below it. Finding
+the nth id goes down one path, picking at each level the child its
+count says n falls in; adding or removing an id adds or takes one on
+its own path. Counts are plain atomic adds, nobody locks anything, and
+ids far apart touch different nodes except near the top.
+
+Ids are handed out in order and never come back, so the tree only grows
+to the right and the nth id is the nth dinner of the list.
+*/
+#ifndef RANK_H
+#define RANK_H
+
+#include <stdint.h>
+
+#define RANK_BITS 6
+#define RANK_WAYS (1 << RANK_BITS)
+// levels of nodes, the last of them holds the bits: 36 bits of id
+#define RANK_DEPTH 5
+
+struct rank_node
+{
+	uint32_t count[RANK_WAYS];	// ids under each child
+	union
+	{
+		struct rank_node *child[RANK_WAYS];
+		uint64_t bits[RANK_WAYS];	// bottom level: a bit per id
+	};
+};
+
+struct rank
+{
+	struct rank_node *root;
+};
+
+// -1 if out of memory
+int rank_init(struct rank *r);
+
+// id is in from now on; -1 if out of memory for its nodes. Every id is
+// added once, and removed at most once after that
+int rank_add(struct rank *r, int id);
+void rank_remove(struct rank *r, int id);
+
+// The index-th id in, counting from 1; 0 if there aren't that many.
+// While ids come and go it's one that was about there
+int rank_select(struct rank *r, int index);
+
+#endif
@@ -13,6 +13,8 @@
 #include <unistd.h>
 #include <time.h>
 
+#include "rt.h"
+
 /*
  * Every second, main generate 0-2 customers. There is one 
  * barber keep serving the customers or sleep.
@@ -36,7 +38,7 @@ void * barber()
 	pthread_mutex_lock(&hair_cut_mutex);
 	//hair_cut()
 	fprintf(stdout,"barber started cut_hair\n");
-	int rd_bar = 1+rand()%2;
+	int rd_bar = 1+rt_rand()%2;
 	sleep(rd_bar);
 	pthread_mutex_unlock(&barber_chair_mutex);
 	fprintf(stdout,"barber finished cut_hair\n");
@@ -69,7 +71,7 @@ void * customer(void* arg)
 int main(int argc, char *argv[])
 {
 	// seed the random number generator
-	srand(time(NULL));
+	rt_srand(time(NULL));
 
 	// initialize the read/write lock and other mutexes
 	pthread_mutex_init(&barber_chair_mutex, NULL);
@@ -104,7 +106,7 @@ int main(int argc, char *argv[])
 	for(int i=0;i<num_customers;i=i+rd_cus)
 		{
 			
-			rd_cus= rand()%3;
+			rd_cus= rt_rand()%3;
 			sleep(1);
 			if (i+rd_cus >= num_customers)
 				rd_cus = num_customers-i;
@@ -13,6 +13,8 @@
 #include <unistd.h>
 #include <time.h>
 
+#include "rt.h"
+
 /*
  * Every second, main generate 0-2 customers. There is one 
  * barber keep serving the customers or sleep.
@@ -51,7 +53,7 @@ void * customer(void* arg)
 		
 		
 		fprintf(stdout,"customer No.%d using resource \n",cust_no);
-		sleep(rand()%3);
+		sleep(rt_rand()%3);
 		resource_count++;
 		return 0;
 		
@@ -70,7 +72,7 @@ void * customer(void* arg)
 int main(int argc, char *argv[])
 {
 	// seed the random number generator
-	srand(time(NULL));
+	rt_srand(time(NULL));
 
 	// initialize the read/write lock and other mutexes
 	pthread_mutex_init(&resource_mutex, NULL);
@@ -104,7 +106,7 @@ int main(int argc, char *argv[])
 	for(int i=0;i<num_customers;i=i+rd_cus)
 		{
 			
-			rd_cus= rand()%5;
+			rd_cus= rt_rand()%5;
 			sleep(1);
 			if (i+rd_cus >= num_customers)
 				rd_cus = num_customers-i;